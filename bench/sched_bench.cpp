@@ -0,0 +1,284 @@
+// Microbenchmarks for the job scheduler
+// Builds against src/sched alone, without SDL or the game, and writes its results
+// as JSON so they can be compared between releases.
+//
+// Usage: sched-bench [--frames N] [--output path]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "sched/job.hpp"
+#include "sched/runner.hpp"
+#include "sched/worker.hpp"
+
+namespace {
+    // A job that does nothing, so only the scheduler's overhead is measured
+    class empty_job final : public sched::job {
+    public:
+        void execute() override {}
+    };
+
+    // One line of the report
+    struct result {
+        std::string name;
+
+        // Describes the setup, such as the execution mode
+        std::vector<std::pair<std::string, std::string>> labels;
+
+        // The measurements and numeric parameters
+        std::vector<std::pair<std::string, double>> values;
+    };
+
+    // Summary of the execution time of a run's frames, in seconds
+    struct frame_stats {
+        double mean{};
+        double p50{};
+        double p99{};
+    };
+
+    const char* mode_name(const sched::execution_mode mode) {
+        return mode == sched::execution_mode::graph ? "graph" : "sub_cycle";
+    }
+
+    // Create a runner with a fixed amount of workers. Workers are left unpinned
+    // so results don't depend on the CPU layout of the machine.
+    std::unique_ptr<sched::runner> make_runner(const sched::execution_mode mode, const std::uint32_t workers) {
+        auto runner = std::make_unique<sched::runner>();
+        runner->mode = mode;
+        runner->pinning = sched::pinning_policy::none;
+        runner->min_workers = workers;
+        runner->max_workers = workers;
+        return runner;
+    }
+
+    // Schedule a number of root jobs with no children
+    void schedule_wide(sched::runner& runner, const std::size_t jobs) {
+        for (std::size_t i = 0; i < jobs; i++)
+            runner.schedule(std::make_shared<empty_job>());
+    }
+
+    // Schedule a single chain of jobs, each the child of the one before
+    void schedule_deep(sched::runner& runner, const std::size_t jobs) {
+        std::shared_ptr<sched::job> parent = std::make_shared<empty_job>();
+        runner.schedule(parent);
+
+        for (std::size_t i = 1; i < jobs; i++) {
+            auto child = std::make_shared<empty_job>();
+            parent->schedule(child);
+            parent = std::move(child);
+        }
+    }
+
+    // Run an exact amount of uncapped frames and summarize their execution time
+    frame_stats run_frames(sched::runner& runner, const std::uint32_t workers, const std::uint64_t frames) {
+        runner.frame_delay = 0;
+        runner.frame_limit = frames;
+        runner.record_frame_times = true;
+        runner.start(false, workers);
+
+        auto times = runner.frame_times();
+        if (times.empty())
+            return {};
+
+        // The first frames build the plan and warm up the workers
+        times.erase(times.begin(), times.begin() + static_cast<std::ptrdiff_t>(times.size() / 10));
+        std::ranges::sort(times);
+
+        frame_stats stats{};
+        for (const auto time : times)
+            stats.mean += time;
+        stats.mean /= static_cast<double>(times.size());
+        stats.p50 = times[times.size() / 2];
+        stats.p99 = times[static_cast<std::size_t>(0.99 * static_cast<double>(times.size() - 1))];
+        return stats;
+    }
+
+    // Worker counts to sweep over: powers of two up to the amount of cores the
+    // runner can use, which honors the process CPU set
+    std::vector<std::uint32_t> worker_counts() {
+        const auto cores = std::max(sched::runner::core_count(), 1u);
+
+        std::vector<std::uint32_t> counts{};
+        for (auto count = 1u; count < cores; count *= 2)
+            counts.push_back(count);
+        counts.push_back(cores);
+        return counts;
+    }
+
+    // The cost of handing an empty job to a worker and running it
+    void bench_dispatch(std::vector<result>& results, const std::uint64_t frames) {
+        constexpr std::size_t jobs = 1024;
+
+        for (const auto mode : { sched::execution_mode::graph, sched::execution_mode::sub_cycle }) {
+            auto runner = make_runner(mode, 1);
+            schedule_wide(*runner, jobs);
+            const auto stats = run_frames(*runner, 1, frames);
+
+            results.push_back({ "dispatch", { { "mode", mode_name(mode) } }, {
+                { "workers", 1.0 },
+                { "jobs", static_cast<double>(jobs) },
+                { "ns_per_job", stats.p50 / jobs * 1e9 },
+                { "ns_per_job_p99", stats.p99 / jobs * 1e9 },
+            } });
+        }
+    }
+
+    // The time it takes every worker to get through a sub-cycle barrier. A chain
+    // of jobs has one job per level, so nearly all of the time is spent waking
+    // the workers and waiting on them.
+    void bench_barrier(std::vector<result>& results, const std::uint64_t frames) {
+        constexpr std::size_t levels = 64;
+
+        for (const auto workers : worker_counts()) {
+            auto runner = make_runner(sched::execution_mode::sub_cycle, workers);
+            schedule_deep(*runner, levels);
+            const auto stats = run_frames(*runner, workers, frames);
+
+            results.push_back({ "barrier", { { "mode", mode_name(sched::execution_mode::sub_cycle) } }, {
+                { "workers", static_cast<double>(workers) },
+                { "levels", static_cast<double>(levels) },
+                { "us_per_sub_cycle", stats.p50 / levels * 1e6 },
+                { "us_per_sub_cycle_p99", stats.p99 / levels * 1e6 },
+            } });
+        }
+    }
+
+    // The same amount of jobs as a single chain versus all side by side
+    void bench_tree_shape(std::vector<result>& results, const std::uint64_t frames) {
+        constexpr std::size_t jobs = 256;
+        const auto workers = worker_counts().back();
+
+        for (const auto mode : { sched::execution_mode::graph, sched::execution_mode::sub_cycle }) {
+            for (const auto deep : { false, true }) {
+                auto runner = make_runner(mode, workers);
+                if (deep)
+                    schedule_deep(*runner, jobs);
+                else
+                    schedule_wide(*runner, jobs);
+                const auto stats = run_frames(*runner, workers, frames);
+
+                results.push_back({ "tree_shape", { { "mode", mode_name(mode) }, { "shape", deep ? "deep" : "wide" } }, {
+                    { "workers", static_cast<double>(workers) },
+                    { "jobs", static_cast<double>(jobs) },
+                    { "us_per_frame", stats.p50 * 1e6 },
+                    { "us_per_frame_p99", stats.p99 * 1e6 },
+                } });
+            }
+        }
+    }
+
+    // The cost of counting the jobs in a tree
+    void bench_job_count(std::vector<result>& results) {
+        constexpr std::size_t roots = 32;
+        constexpr std::size_t children = 31;
+        constexpr std::size_t calls = 1000;
+
+        sched::runner runner{};
+        for (std::size_t i = 0; i < roots; i++) {
+            const auto root = std::make_shared<empty_job>();
+            for (std::size_t j = 0; j < children; j++)
+                root->schedule(std::make_shared<empty_job>());
+            runner.schedule(root);
+        }
+
+        // Keep the result alive so the calls aren't optimized out
+        std::size_t total = 0;
+        const auto start = sched::runner::clock::now();
+        for (std::size_t i = 0; i < calls; i++)
+            total += runner.job_count();
+        const auto elapsed = std::chrono::duration_cast<sched::runner::duration>(sched::runner::clock::now() - start).count();
+
+        results.push_back({ "job_count", {}, {
+            { "jobs", static_cast<double>(total / calls) },
+            { "us_per_call", elapsed / calls * 1e6 },
+        } });
+    }
+
+    // How closely each pacing policy holds a frame rate
+    void bench_pacing(std::vector<result>& results) {
+        constexpr std::uint64_t frames = 240;
+
+        for (const auto policy : { sched::pacing_policy::sleep, sched::pacing_policy::timer }) {
+            for (const auto rate : { 60, 144 }) {
+                auto runner = make_runner(sched::execution_mode::graph, 1);
+                schedule_wide(*runner, 16);
+                runner->pacing = policy;
+                runner->frame_delay = 1.0 / rate;
+                runner->frame_limit = frames;
+                runner->start(false, 1);
+
+                const auto jitter = runner->frame_jitter();
+                results.push_back({ "pacing", { { "policy", policy == sched::pacing_policy::timer ? "timer" : "sleep" } }, {
+                    { "rate", static_cast<double>(rate) },
+                    { "jitter_us_p50", jitter.p50 * 1e6 },
+                    { "jitter_us_p95", jitter.p95 * 1e6 },
+                    { "jitter_us_p99", jitter.p99 * 1e6 },
+                    { "jitter_us_max", jitter.max * 1e6 },
+                } });
+            }
+        }
+    }
+
+    void write_json(std::ostream& out, const std::vector<result>& results) {
+        out << "{\n  \"benchmarks\": [\n";
+
+        for (std::size_t i = 0; i < results.size(); i++) {
+            const auto& entry = results[i];
+            out << "    { \"name\": \"" << entry.name << '"';
+            for (const auto& [key, value] : entry.labels)
+                out << ", \"" << key << "\": \"" << value << '"';
+            for (const auto& [key, value] : entry.values)
+                out << ", \"" << key << "\": " << value;
+            out << (i + 1 < results.size() ? " },\n" : " }\n");
+        }
+
+        out << "  ]\n}\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::uint64_t frames = 1000;
+    std::string output{};
+
+    for (auto i = 1; i < argc; i++) {
+        const std::string_view arg{ argv[i] };
+
+        if (arg == "--frames" && i + 1 < argc)
+            frames = std::max<std::uint64_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        else if (arg == "--output" && i + 1 < argc)
+            output = argv[++i];
+        else {
+            std::cerr << "usage: sched-bench [--frames N] [--output path]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<result> results{};
+    bench_dispatch(results, frames);
+    bench_barrier(results, frames);
+    bench_tree_shape(results, frames);
+    bench_job_count(results);
+    bench_pacing(results);
+
+    if (output.empty()) {
+        write_json(std::cout, results);
+        return 0;
+    }
+
+    std::ofstream file{ output };
+    if (!file) {
+        std::cerr << "Failed to open " << output << std::endl;
+        return 1;
+    }
+    write_json(file, results);
+    return 0;
+}
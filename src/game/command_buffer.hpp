@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "sched/frame_arena.hpp"
+
+namespace game {
+    // An append-only list of queued writes. Commands are stored back to back in
+    // an arena owned by the buffer, closure and all, so queueing one is a bump
+    // allocation rather than a trip to the heap. The arena is rewound once the
+    // buffer has been applied, keeping its blocks for the next frame.
+    // Not thread-safe. The write job gives every thread a buffer of its own.
+    class command_buffer {
+    public:
+        // The header every queued command starts with
+        struct command {
+            command* next;
+
+            // Where the command falls in the order of every queued write
+            std::uint64_t sequence;
+
+            // Run the command if asked to, then destroy it
+            void (*apply)(command& self, bool run);
+
+            // The object the command writes to, or nullptr for a closure that could
+            // write to anything
+            void* target;
+
+            // Determines if the command only touches its target, so it may be
+            // applied in parallel with commands targeting other objects
+            bool parallel;
+
+            // Determine if another setter call with the same apply function calls
+            // the same setter. Only set for setter calls.
+            bool (*same_property)(const command& self, const command& other);
+
+            // Set once a later call to the same setter on the same object has been
+            // queued, in which case this one is dropped instead of applied
+            bool superseded;
+        };
+
+    private:
+        // A queued closure, stored in place
+        template <class Fn>
+        struct closure final : command {
+            Fn fn;
+
+            template <class F>
+            closure(const std::uint64_t sequence, void* target, F&& f)
+                : command{ nullptr, sequence, &closure::apply_closure, target, target != nullptr, nullptr, false },
+                  fn(std::forward<F>(f)) {}
+
+            static void apply_closure(command& self, const bool run) {
+                auto& queued = static_cast<closure&>(self);
+
+                // The closure is destroyed even if running it throws
+                struct destroy {
+                    closure& queued;
+                    ~destroy() { queued.~closure(); }
+                } guard{ queued };
+
+                if (run)
+                    queued.fn();
+            }
+        };
+
+        // A queued call to a setter, the common case, which needs no closure type
+        // of its own at the call site
+        template <class T, class V>
+        struct property final : command {
+            void (T::*setter)(V);
+            std::remove_cvref_t<V> value;
+
+            template <class U>
+            property(const std::uint64_t sequence, T* target, const bool parallel, void (T::*setter)(V), U&& value)
+                : command{ nullptr, sequence, &property::apply_property, target, parallel, &property::same_setter, false },
+                  setter(setter), value(std::forward<U>(value)) {}
+
+            static bool same_setter(const command& self, const command& other) {
+                return static_cast<const property&>(self).setter == static_cast<const property&>(other).setter;
+            }
+
+            static void apply_property(command& self, const bool run) {
+                auto& queued = static_cast<property&>(self);
+
+                struct destroy {
+                    property& queued;
+                    ~destroy() { queued.~property(); }
+                } guard{ queued };
+
+                if (run)
+                    (static_cast<T*>(queued.target)->*queued.setter)(std::move(queued.value));
+            }
+        };
+
+        // Storage for the commands, rewound once they have all been taken and applied
+        sched::frame_arena _memory{ 16 * 1024 };
+
+        // The queued commands in order, and the last one for appending
+        command* _first{};
+        command* _last{};
+
+        // The amount of commands and setter calls queued since the buffer was
+        // last released
+        std::size_t _size{};
+        std::size_t _properties{};
+
+        // Construct a command in the arena and append it
+        template <class C, class... Args>
+        void emplace(Args&&... args) {
+            const auto queued = new (_memory.allocate(sizeof(C), alignof(C))) C(std::forward<Args>(args)...);
+            if (_last == nullptr)
+                _first = queued;
+            else
+                _last->next = queued;
+            _last = queued;
+            _size++;
+        }
+
+    public:
+        command_buffer() = default;
+
+        // Destroy the commands that were never applied
+        ~command_buffer() { clear(); }
+
+        command_buffer(const command_buffer&) = delete;
+        command_buffer& operator=(const command_buffer&) = delete;
+
+        // Determine if there are no commands queued
+        [[nodiscard]] bool empty() const noexcept { return _first == nullptr; }
+
+        // Get the first command, or nullptr if there is none. The rest follow
+        // through next.
+        [[nodiscard]] command* front() noexcept { return _first; }
+        [[nodiscard]] const command* front() const noexcept { return _first; }
+
+        // Get the amount of commands queued since the buffer was last released
+        [[nodiscard]] std::size_t size() const noexcept { return _size; }
+
+        // Get the amount of setter calls queued since the buffer was last released
+        [[nodiscard]] std::size_t properties() const noexcept { return _properties; }
+
+        // Queue a closure to be called. Give the object it writes to as the
+        // target if it only touches that one, or nullptr otherwise.
+        template <class Fn>
+        void push(const std::uint64_t sequence, void* target, Fn&& fn) {
+            emplace<closure<std::decay_t<Fn>>>(sequence, target, std::forward<Fn>(fn));
+        }
+
+        // Queue a call to a setter of an object. It may only be applied in
+        // parallel if the setter touches nothing but the object.
+        template <class T, class V, class U>
+        void push(const std::uint64_t sequence, T& target, const bool parallel, void (T::*setter)(V), U&& value) {
+            emplace<property<T, V>>(sequence, &target, parallel, setter, std::forward<U>(value));
+            _properties++;
+        }
+
+        // Remove the first command without applying it. The caller has to apply
+        // it, which destroys it, before the buffer is released.
+        command* take_front() noexcept {
+            const auto queued = _first;
+            _first = queued->next;
+            if (_first == nullptr)
+                _last = nullptr;
+
+            return queued;
+        }
+
+        // Make the memory of the taken commands available again. Every command
+        // has to have been taken and applied.
+        void release() noexcept {
+            _memory.reset();
+            _size = 0;
+            _properties = 0;
+        }
+
+        // Destroy every command without applying it
+        void clear() noexcept {
+            while (_first != nullptr) {
+                const auto queued = _first;
+                _first = queued->next;
+                queued->apply(*queued, false);
+            }
+
+            _last = nullptr;
+            release();
+        }
+    };
+}
@@ -0,0 +1,215 @@
+#include "ecs.hpp"
+
+#include <mutex>
+
+namespace game::ecs {
+    namespace {
+        // Every component type used so far, indexed by component ID
+        std::mutex component_mutex{};
+        std::vector<component_info> components{};
+
+        std::size_t align_up(const std::size_t offset, const std::size_t alignment) {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    component_id detail::register_component(const component_info& info) {
+        std::lock_guard lock{ component_mutex };
+        components.push_back(info);
+        return static_cast<component_id>(components.size() - 1);
+    }
+
+    component_info detail::component(const component_id id) {
+        std::lock_guard lock{ component_mutex };
+        return components.at(id);
+    }
+
+    archetype::archetype(std::vector<component_id> ids) : _ids(std::move(ids)) {
+        // Fit as many entities in a chunk as we can, leaving room to align each
+        // component array
+        auto stride = sizeof(entity);
+        auto padding = std::size_t{ 0 };
+        for (const auto id : _ids) {
+            const auto info = detail::component(id);
+            _columns.push_back({ id, info, 0 });
+            stride += info.size;
+            padding += info.alignment;
+        }
+
+        _capacity = static_cast<std::uint32_t>(std::max<std::size_t>(
+            chunk_size > padding ? (chunk_size - padding) / stride : 0, 1));
+
+        auto offset = sizeof(entity) * _capacity;
+        for (auto& column : _columns) {
+            column.offset = align_up(offset, column.info.alignment);
+            offset = column.offset + column.info.size * _capacity;
+        }
+        _chunk_bytes = align_up(offset, chunk_alignment);
+    }
+
+    archetype::~archetype() {
+        for (std::uint32_t chunk = 0; chunk < _chunks.size(); chunk++) {
+            for (std::uint32_t row = 0; row < _chunks[chunk].count; row++) {
+                for (std::size_t column = 0; column < _columns.size(); column++)
+                    _columns[column].info.destroy(component(column, chunk, row));
+            }
+        }
+    }
+
+    void* archetype::component(const std::size_t column, const std::uint32_t chunk, const std::uint32_t row) const {
+        const auto& found = _columns[column];
+        return _chunks[chunk].data.get() + found.offset + found.info.size * row;
+    }
+
+    std::pair<std::uint32_t, std::uint32_t> archetype::push(const entity entity) {
+        if (_chunks.empty() || _chunks.back().count == _capacity) {
+            const auto data = static_cast<std::byte*>(::operator new[](_chunk_bytes, std::align_val_t{ chunk_alignment }));
+            _chunks.push_back({ std::unique_ptr<std::byte[], chunk::deleter>(data), 0 });
+        }
+
+        auto& last = _chunks.back();
+        const auto row = last.count++;
+        new (reinterpret_cast<ecs::entity*>(last.data.get()) + row) ecs::entity{ entity };
+        return { static_cast<std::uint32_t>(_chunks.size() - 1), row };
+    }
+
+    entity archetype::erase(const std::uint32_t chunk, const std::uint32_t row) {
+        auto& last = _chunks.back();
+        const auto last_chunk = static_cast<std::uint32_t>(_chunks.size() - 1);
+        const auto last_row = last.count - 1;
+
+        // Move the last entity into the hole
+        ecs::entity moved{};
+        if (chunk != last_chunk || row != last_row) {
+            for (std::size_t column = 0; column < _columns.size(); column++)
+                _columns[column].info.relocate(component(column, chunk, row), component(column, last_chunk, last_row));
+
+            moved = entities(last)[last_row];
+            entities(_chunks[chunk])[row] = moved;
+        }
+
+        // Only the first chunk is kept around once it is empty, so the last chunk
+        // always holds the last entity
+        if (--last.count == 0 && _chunks.size() > 1)
+            _chunks.pop_back();
+
+        return moved;
+    }
+
+    registry::registry() {
+        // Entities without components live here
+        find_archetype({});
+    }
+
+    archetype& registry::find_archetype(std::vector<component_id> ids) {
+        std::ranges::sort(ids);
+        if (std::ranges::adjacent_find(ids) != ids.end())
+            throw std::runtime_error("Entity has the same component more than once");
+
+        auto& found = _archetypes[ids];
+        if (found == nullptr) {
+            found = std::make_unique<ecs::archetype>(std::move(ids));
+            _archetype_list.push_back(found.get());
+        }
+
+        return *found;
+    }
+
+    archetype& registry::with(ecs::archetype& source, const component_id id) {
+        auto& target = source._added[id];
+        if (target == nullptr) {
+            auto ids = source.ids();
+            ids.push_back(id);
+            target = &find_archetype(std::move(ids));
+        }
+
+        return *target;
+    }
+
+    archetype& registry::without(ecs::archetype& source, const component_id id) {
+        auto& target = source._removed[id];
+        if (target == nullptr) {
+            auto ids = source.ids();
+            std::erase(ids, id);
+            target = &find_archetype(std::move(ids));
+        }
+
+        return *target;
+    }
+
+    registry::record& registry::checked(const entity entity) {
+        if (!alive(entity))
+            throw std::runtime_error("Entity has been destroyed");
+
+        return _records[entity.index];
+    }
+
+    entity registry::allocate() {
+        _size++;
+
+        if (!_free.empty()) {
+            const auto index = _free.back();
+            _free.pop_back();
+            return { index, _records[index].generation };
+        }
+
+        _records.emplace_back();
+        return { static_cast<std::uint32_t>(_records.size() - 1), 0 };
+    }
+
+    void registry::move(const entity entity, ecs::archetype& target) {
+        auto& record = _records[entity.index];
+        const auto source = record.archetype;
+        const auto [chunk, row] = target.push(entity);
+
+        // The columns of both archetypes are sorted by ID, so they can be
+        // walked side by side
+        std::size_t target_column = 0;
+        for (std::size_t column = 0; column < source->_columns.size(); column++) {
+            const auto id = source->_ids[column];
+            while (target_column < target._ids.size() && target._ids[target_column] < id)
+                target_column++;
+
+            const auto from = source->component(column, record.chunk, record.row);
+            if (target_column < target._ids.size() && target._ids[target_column] == id)
+                source->_columns[column].info.relocate(target.component(target_column, chunk, row), from);
+            else
+                source->_columns[column].info.destroy(from);
+        }
+
+        erase_row(record);
+        record.archetype = &target;
+        record.chunk = chunk;
+        record.row = row;
+    }
+
+    void registry::erase_row(const record& record) {
+        const auto moved = record.archetype->erase(record.chunk, record.row);
+        if (moved) {
+            auto& moved_record = _records[moved.index];
+            moved_record.chunk = record.chunk;
+            moved_record.row = record.row;
+        }
+    }
+
+    void registry::destroy(const entity entity) {
+        auto& record = checked(entity);
+        const auto archetype = record.archetype;
+
+        for (std::size_t column = 0; column < archetype->_columns.size(); column++)
+            archetype->_columns[column].info.destroy(archetype->component(column, record.chunk, record.row));
+        erase_row(record);
+
+        // Bumping the generation invalidates every handle to the entity
+        record.archetype = nullptr;
+        record.generation++;
+        _free.push_back(entity.index);
+        _size--;
+    }
+
+    bool registry::alive(const entity entity) const {
+        return entity.index < _records.size()
+            && _records[entity.index].archetype != nullptr
+            && _records[entity.index].generation == entity.generation;
+    }
+}
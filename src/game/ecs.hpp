@@ -0,0 +1,382 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "entity.hpp"
+#include "sched/frame_arena.hpp"
+#include "sched/parallel.hpp"
+
+// Entity-component-system storage for large amounts of simple game entities, such
+// as units. Entities with the same set of components share an archetype, which
+// stores them in chunks with one contiguous array per component. Queries stream
+// through those arrays instead of chasing pointers through the object tree.
+
+namespace game::ecs {
+    // Identifies a component type, assigned the first time the type is used
+    using component_id = std::uint32_t;
+
+    // Chunks are aligned to a cache line, which is the most a component may ask for
+    constexpr std::size_t chunk_alignment = 64;
+
+    // The size of a chunk of component storage, in bytes
+    constexpr std::size_t chunk_size = 16 * 1024;
+
+    // How a component type is stored, without knowing the type
+    struct component_info {
+        std::size_t size;
+        std::size_t alignment;
+
+        // Move construct a component into uninitialized memory and destroy the source
+        void (*relocate)(void* destination, void* source);
+
+        // Destroy a component
+        void (*destroy)(void* component);
+    };
+
+    namespace detail {
+        // Assign an ID to a new component type
+        component_id register_component(const component_info& info);
+
+        // Get how a component type is stored
+        component_info component(component_id id);
+
+        template <class T>
+        component_info make_component_info() {
+            static_assert(alignof(T) <= chunk_alignment, "component alignment exceeds the chunk alignment");
+
+            return {
+                sizeof(T),
+                alignof(T),
+                [](void* destination, void* source) {
+                    new (destination) T(std::move(*static_cast<T*>(source)));
+                    static_cast<T*>(source)->~T();
+                },
+                [](void* component) { static_cast<T*>(component)->~T(); }
+            };
+        }
+    }
+
+    // Get the ID of a component type. Qualifiers are ignored, so a const component
+    // in a query refers to the same storage as the mutable one.
+    template <class T>
+    component_id component_id_of() {
+        using type = std::remove_cvref_t<T>;
+        if constexpr (!std::is_same_v<T, type>) {
+            return component_id_of<type>();
+        }
+        else {
+            static const auto id = detail::register_component(detail::make_component_info<type>());
+            return id;
+        }
+    }
+
+    // A block of memory holding a number of entities of one archetype. The
+    // entities come first, followed by one array per component.
+    struct chunk {
+        struct deleter {
+            void operator()(std::byte* data) const noexcept {
+                ::operator delete[](data, std::align_val_t{ chunk_alignment });
+            }
+        };
+
+        std::unique_ptr<std::byte[], deleter> data;
+
+        // The amount of entities in the chunk
+        std::uint32_t count{};
+    };
+
+    // Stores every entity that has exactly the same set of components
+    // Entities are kept densely packed: removing one moves the last entity of the
+    // archetype into its place.
+    class archetype {
+        struct column {
+            component_id id;
+            component_info info;
+
+            // Where the component array starts in a chunk
+            std::size_t offset;
+        };
+
+        // The component types, sorted by ID
+        std::vector<component_id> _ids;
+
+        // The component arrays, in the same order as the IDs
+        std::vector<column> _columns;
+
+        // The amount of entities that fit in a chunk, and the size of a chunk
+        std::uint32_t _capacity{};
+        std::size_t _chunk_bytes{};
+
+        // Every chunk but the last one is full
+        std::vector<chunk> _chunks;
+
+        // Archetypes reached by adding or removing one component, cached as they
+        // are first looked up
+        std::unordered_map<component_id, archetype*> _added;
+        std::unordered_map<component_id, archetype*> _removed;
+
+    public:
+        explicit archetype(std::vector<component_id> ids);
+
+        // Destroy every component in the archetype
+        ~archetype();
+
+        archetype(const archetype&) = delete;
+        archetype& operator=(const archetype&) = delete;
+
+        // Get the component types, sorted by ID
+        [[nodiscard]] const auto& ids() const { return _ids; }
+
+        // Determine if the archetype has a component type
+        [[nodiscard]] bool has(const component_id id) const {
+            return std::ranges::binary_search(_ids, id);
+        }
+
+        // Get the column of a component type. The archetype must have it.
+        [[nodiscard]] std::size_t column_of(const component_id id) const {
+            return static_cast<std::size_t>(std::ranges::lower_bound(_ids, id) - _ids.begin());
+        }
+
+        // Get the amount of entities that fit in a chunk
+        [[nodiscard]] std::uint32_t capacity() const { return _capacity; }
+
+        // Get the chunks of the archetype. Every chunk but the last one is full.
+        [[nodiscard]] std::span<chunk> chunks() { return _chunks; }
+
+        // Get the entities stored in a chunk
+        [[nodiscard]] static std::span<entity> entities(const chunk& chunk) {
+            return { reinterpret_cast<entity*>(chunk.data.get()), chunk.count };
+        }
+
+        // Get the array of a component in a chunk
+        template <class T>
+        [[nodiscard]] T* column(const chunk& chunk, const std::size_t column) const {
+            return reinterpret_cast<T*>(chunk.data.get() + _columns[column].offset);
+        }
+
+        // Get the address of a component of an entity
+        [[nodiscard]] void* component(std::size_t column, std::uint32_t chunk, std::uint32_t row) const;
+
+        // Add an entity at the end of the archetype, returning its chunk and row.
+        // Its components are left uninitialized.
+        std::pair<std::uint32_t, std::uint32_t> push(entity entity);
+
+        // Remove an entity by moving the last entity into its place. Its components
+        // must have been destroyed or moved out already. Returns the entity that
+        // took its place, or a null entity if it was the last one.
+        entity erase(std::uint32_t chunk, std::uint32_t row);
+
+        // Friend classes
+        friend class registry;
+    };
+
+    // Owns entities and their components
+    // Creating and destroying entities and adding or removing components is not
+    // thread-safe, and must not happen during a query. Queries may run from
+    // several jobs at once as long as they don't write the same components.
+    class registry {
+        struct record {
+            ecs::archetype* archetype{};
+            std::uint32_t chunk{};
+            std::uint32_t row{};
+            std::uint32_t generation{};
+        };
+
+        // Where every entity is stored, indexed by the entity index
+        std::vector<record> _records;
+
+        // Indices of destroyed entities, ready for reuse
+        std::vector<std::uint32_t> _free;
+
+        // Every archetype, keyed by its sorted component types
+        std::map<std::vector<component_id>, std::unique_ptr<ecs::archetype>> _archetypes;
+
+        // Every archetype in order of creation, walked by queries
+        std::vector<ecs::archetype*> _archetype_list;
+
+        // The amount of live entities
+        std::size_t _size{};
+
+        // Get or create the archetype with the given component types
+        ecs::archetype& find_archetype(std::vector<component_id> ids);
+
+        // Get the archetype with one component type added or removed
+        ecs::archetype& with(ecs::archetype& source, component_id id);
+        ecs::archetype& without(ecs::archetype& source, component_id id);
+
+        // Get the record of a live entity, throwing if it was destroyed
+        record& checked(entity entity);
+
+        // Take a free entity slot
+        entity allocate();
+
+        // Move an entity into another archetype. Components the target shares
+        // are moved over and the rest are destroyed.
+        void move(entity entity, ecs::archetype& target);
+
+        // Remove the row of a record, fixing up the record of the entity that
+        // took its place
+        void erase_row(const record& record);
+
+        // Get the address of a component of the entity in a record
+        [[nodiscard]] static void* address(const record& record, const component_id id) {
+            return record.archetype->component(record.archetype->column_of(id), record.chunk, record.row);
+        }
+
+        template <class... Ts, class Fn, std::size_t... Is>
+        static void call_chunk(const ecs::archetype& archetype, const chunk& chunk, const std::size_t* columns,
+                               Fn& fn, std::index_sequence<Is...>) {
+            fn(std::span<const entity>{ ecs::archetype::entities(chunk) },
+               std::span<Ts>{ archetype.column<std::remove_const_t<Ts>>(chunk, columns[Is]), chunk.count }...);
+        }
+
+    public:
+        registry();
+
+        registry(const registry&) = delete;
+        registry& operator=(const registry&) = delete;
+
+        // Create an entity with the given components
+        template <class... Ts>
+        entity create(Ts&&... components) {
+            auto& target = find_archetype({ component_id_of<Ts>()... });
+
+            const auto created = allocate();
+            auto& record = _records[created.index];
+            record.archetype = &target;
+            std::tie(record.chunk, record.row) = target.push(created);
+
+            (new (address(record, component_id_of<Ts>())) std::remove_cvref_t<Ts>(std::forward<Ts>(components)), ...);
+            return created;
+        }
+
+        // Destroy an entity along with its components
+        void destroy(entity entity);
+
+        // Determine if an entity has not been destroyed
+        [[nodiscard]] bool alive(entity entity) const;
+
+        // Get the amount of live entities
+        [[nodiscard]] std::size_t size() const { return _size; }
+
+        // Determine if an entity has a component
+        template <class T>
+        [[nodiscard]] bool has(const entity entity) const {
+            return alive(entity) && _records[entity.index].archetype->has(component_id_of<T>());
+        }
+
+        // Get a component of an entity, or nullptr if the entity doesn't have it
+        template <class T>
+        [[nodiscard]] T* try_get(const entity entity) {
+            if (!has<T>(entity))
+                return nullptr;
+
+            return static_cast<T*>(address(_records[entity.index], component_id_of<T>()));
+        }
+
+        // Get a component of an entity, throwing if the entity doesn't have it
+        template <class T>
+        [[nodiscard]] T& get(const entity entity) {
+            const auto found = try_get<T>(entity);
+            if (found == nullptr)
+                throw std::runtime_error("Entity does not have the component");
+
+            return *found;
+        }
+
+        // Add a component to an entity, or replace it if the entity already has it.
+        // Adding a component moves the entity to another archetype.
+        template <class T>
+        T& add(const entity entity, T component) {
+            const auto id = component_id_of<T>();
+            auto& record = checked(entity);
+            if (record.archetype->has(id))
+                return *static_cast<T*>(address(record, id)) = std::move(component);
+
+            move(entity, with(*record.archetype, id));
+            return *new (address(record, id)) T(std::move(component));
+        }
+
+        // Remove a component from an entity, if it has it
+        template <class T>
+        void remove(const entity entity) {
+            const auto id = component_id_of<T>();
+            auto& record = checked(entity);
+            if (record.archetype->has(id))
+                move(entity, without(*record.archetype, id));
+        }
+
+        // Call fn(entities, components...) for every chunk holding entities with
+        // all of the given components, with one span per component. Components
+        // that are only read should be given as const.
+        template <class... Ts, class Fn>
+        void each_chunk(Fn&& fn) {
+            static_assert(sizeof...(Ts) > 0, "a query needs at least one component");
+
+            for (const auto archetype : _archetype_list) {
+                if (!(archetype->has(component_id_of<Ts>()) && ...))
+                    continue;
+
+                const std::size_t columns[] = { archetype->column_of(component_id_of<Ts>())... };
+                for (const auto& chunk : archetype->chunks()) {
+                    if (chunk.count != 0)
+                        call_chunk<Ts...>(*archetype, chunk, columns, fn, std::index_sequence_for<Ts...>{});
+                }
+            }
+        }
+
+        // Call fn(entity, components...) for every entity with all of the given
+        // components
+        template <class... Ts, class Fn>
+        void each(Fn&& fn) {
+            each_chunk<Ts...>([&fn](const std::span<const entity> entities, const std::span<Ts>... components) {
+                for (std::size_t i = 0; i < entities.size(); i++)
+                    fn(entities[i], components[i]...);
+            });
+        }
+
+        // Like each_chunk, but the chunks are spread over the runner's workers
+        // with sched::parallel_for. fn may be called from several threads at once.
+        template <class... Ts, class Fn>
+        void parallel_each_chunk(Fn&& fn) {
+            static_assert(sizeof...(Ts) > 0, "a query needs at least one component");
+
+            struct match {
+                const ecs::archetype* archetype;
+                const ecs::chunk* chunk;
+                std::size_t columns[sizeof...(Ts)];
+            };
+
+            // The matches only live for this call, so they come out of the frame arena
+            std::pmr::vector<match> matches{ &sched::frame_memory() };
+            for (const auto archetype : _archetype_list) {
+                if (!(archetype->has(component_id_of<Ts>()) && ...))
+                    continue;
+
+                for (const auto& chunk : archetype->chunks()) {
+                    if (chunk.count != 0)
+                        matches.push_back({ archetype, &chunk, { archetype->column_of(component_id_of<Ts>())... } });
+                }
+            }
+
+            sched::parallel_for({ 0, matches.size() }, 1, [&](const sched::range& piece) {
+                for (auto i = piece.begin; i < piece.end; i++) {
+                    const auto& found = matches[i];
+                    call_chunk<Ts...>(*found.archetype, *found.chunk, found.columns, fn, std::index_sequence_for<Ts...>{});
+                }
+            });
+        }
+    };
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+
+namespace game::ecs {
+    // Identifies an entity in a registry. The generation tells apart entities that
+    // were given the same slot after one of them was destroyed, so a handle to a
+    // destroyed entity never refers to a new one.
+    struct entity {
+        std::uint32_t index{ ~0u };
+        std::uint32_t generation{};
+
+        bool operator==(const entity&) const = default;
+
+        // Determine if the handle refers to an entity at all. The entity it refers
+        // to may have been destroyed since.
+        explicit operator bool() const { return index != ~0u; }
+    };
+}
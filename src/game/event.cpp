@@ -5,19 +5,35 @@
 #include <future>
 
 namespace game {
-    void event_base::connect(connection_base::cb_wrapper callback) {
+    std::shared_ptr<connection_base> event_base::connect(connection_base::cb_wrapper callback) {
         auto cn = std::make_shared<connection_base>(ref(), callback); // err
+
+        std::lock_guard lock{ _cn_mutex };
         _cn_vector.push_back(cn);
+        return cn;
     }
 
     void event_base::disconnect_all() {
-        for (auto& cn : _cn_vector)
+        // Detaching takes the lock as well, so take the connections out first
+        std::vector<std::shared_ptr<connection_base>> connections{};
+        {
+            std::lock_guard lock{ _cn_mutex };
+            connections.swap(_cn_vector);
+        }
+
+        for (auto& cn : connections)
             cn->detach();
-        _cn_vector.clear();
     }
 
     void event_base::fire(std::any context) {
-        for (auto& cn : _cn_vector) {
+        // Other jobs may connect or detach while we fire, so work on a copy
+        std::vector<std::shared_ptr<connection_base>> connections{};
+        {
+            std::lock_guard lock{ _cn_mutex };
+            connections = _cn_vector;
+        }
+
+        for (auto& cn : connections) {
             if (cn->alive())
                 cn->fire(context);
         }
@@ -40,8 +56,10 @@ namespace game {
     }
 
     void connection_base::detach() {
-        _alive = false;
-        std::ranges::remove(_event->_cn_vector, shared_from_this());
+        _alive.store(false, std::memory_order_release);
+
+        std::lock_guard lock{ _event->_cn_mutex };
+        std::erase(_event->_cn_vector, shared_from_this());
     }
 
     void connection_base::fire(std::any context) { 
@@ -6,19 +6,23 @@
 #include <algorithm>
 #include <functional>
 #include <any>
+#include <atomic>
+#include <coroutine>
+#include <utility>
 
 namespace game {
     // Forward declaration
     class event_base;
     template <class T = std::any> class connection;
     template <class T = std::any> class event;
+    template <class T = std::any> class event_awaiter;
 
     template <class T>
     using event_callback = std::function<void(T)>;
 
     class connection_base : public std::enable_shared_from_this<connection_base> {
         // Determines if the callback will be invoked when the event is fired
-        bool _alive = true;
+        std::atomic<bool> _alive = true;
 
         // The event that this connection is bound to
         std::shared_ptr<event_base> _event;
@@ -45,14 +49,14 @@ namespace game {
             : _event(event), _callback(callback) {}
 
         // Determine if this connection is attached to the event
-        [[nodiscard]] bool alive() { return _alive; }
+        [[nodiscard]] bool alive() { return _alive.load(std::memory_order_acquire); }
 
         // Get the event that this connection is bound to
         [[nodiscard]] std::shared_ptr<event_base> event() { return _event; }
 
         // Attach this connection to the event
         void attach() {
-            _alive = true;
+            _alive.store(true, std::memory_order_release);
         }
 
         // Detach this connection from the event
@@ -71,6 +75,10 @@ namespace game {
 
     class event_base : public std::enable_shared_from_this<event_base> {
     protected:
+        // Guards the connections, which are connected, detached and fired from
+        // whichever jobs use the event
+        std::mutex _cn_mutex;
+
         // A collection of connections to this event
         std::vector<std::shared_ptr<connection_base>> _cn_vector;
 
@@ -81,17 +89,19 @@ namespace game {
         }
 
         // Connect a callback to this event
-        void connect(connection_base::cb_wrapper callback);
+        std::shared_ptr<connection_base> connect(connection_base::cb_wrapper callback);
 
         // Connect a callback to this event
-        void connect(std::function<void(std::any)> callback) {
-            connect(connection_base::cb_wrapper(callback));
+        std::shared_ptr<connection_base> connect(std::function<void(std::any)> callback) {
+            return connect(connection_base::cb_wrapper(callback));
         }
 
-        // Fire this event, invoking all connections
+        // Fire this event, invoking all connections. The connections are copied
+        // first, so callbacks may connect or detach while the event fires.
         void fire(std::any context);
 
         // Yield on this event, waiting for a connection to fire, then returning the result
+        // This blocks the calling worker. Coroutine jobs should co_await next() instead.
         std::any yield();
 
         // Disconnect everything in this event
@@ -128,8 +138,8 @@ namespace game {
         using connection_t = connection<T>;
 
         // Connect a callback to this event
-        void connect(event_callback<T> callback) {
-            event_base::connect([callback](std::any arg) {
+        std::shared_ptr<connection_base> connect(event_callback<T> callback) {
+            return event_base::connect([callback](std::any arg) {
                 callback(std::any_cast<T>(arg));
             });
         }
@@ -143,5 +153,53 @@ namespace game {
         T yield() {
             return std::any_cast<T>(event_base::yield());
         }
+
+        // Suspend a coroutine job until the event fires, without holding up the
+        // worker. Use as co_await event->next(), which results in the context.
+        event_awaiter<T> next() {
+            return event_awaiter<T>{ ref() };
+        }
+    };
+
+    // Awaitable returned by event::next
+    // Include game/event_awaiter.hpp to co_await it. Keeping await_suspend out of
+    // here spares every user of events from pulling in the scheduler.
+    template <class T>
+    class event_awaiter {
+        // Shared with the connection, which may fire after the job is gone
+        struct state {
+            std::atomic<bool> fired{ false };
+            std::any context;
+        };
+
+        std::shared_ptr<event_base> _event;
+        std::shared_ptr<state> _state = std::make_shared<state>();
+        std::shared_ptr<connection_base> _connection;
+
+    public:
+        explicit event_awaiter(std::shared_ptr<event_base> event)
+            : _event(std::move(event)) {}
+
+        event_awaiter(const event_awaiter&) = delete;
+        event_awaiter& operator=(const event_awaiter&) = delete;
+
+        // The job may be destroyed while it waits, in which case the coroutine
+        // never resumes, so the connection is detached here as well
+        ~event_awaiter() {
+            if (_connection != nullptr)
+                _connection->detach();
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        // Connect to the event and have it wake the coroutine job. Defined in
+        // game/event_awaiter.hpp.
+        template <class Promise>
+        void await_suspend(std::coroutine_handle<Promise> handle);
+
+        T await_resume() {
+            std::exchange(_connection, nullptr)->detach();
+            return std::any_cast<T>(std::move(_state->context));
+        }
     };
 }
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <memory>
+
+#include "event.hpp"
+#include "sched/coroutine_job.hpp"
+
+namespace game {
+    template <class T>
+    template <class Promise>
+    void event_awaiter<T>::await_suspend(std::coroutine_handle<Promise> handle) {
+        sched::coroutine_job* const job = handle.promise().job;
+        job->await_wake();
+
+        // Only the first firing counts. The job is held weakly so a pending
+        // connection does not keep it alive.
+        std::weak_ptr<sched::job> weak_job = job->ref();
+        _connection = _event->connect([weak_job, state = _state](std::any context) {
+            const auto waiting_job = weak_job.lock();
+            if (!waiting_job || state->fired.exchange(true, std::memory_order_acq_rel))
+                return;
+
+            state->context = std::move(context);
+            static_cast<sched::coroutine_job*>(waiting_job.get())->wake();
+        });
+    }
+}
@@ -6,7 +6,7 @@ namespace game {
     void object::add_child(const std::shared_ptr<object> &p_child) {
         // Queue child addition
         auto& writer = world::instance()->write_job;
-        writer->enqueue([this, p_child] { _children.push_back(p_child); });
+        writer->enqueue(*this, [this, p_child] { _children.push_back(p_child); });
     }
 
     void object::remove_child(const std::shared_ptr<object> &p_child) {
@@ -21,7 +21,7 @@ namespace game {
 
         // Queue child removal
         auto& writer = world::instance()->write_job;
-        writer->enqueue([this, found] { _children.erase(found); });
+        writer->enqueue(*this, [this, found] { _children.erase(found); });
     }
 
     object& object::find_child(const std::string_view name) const {
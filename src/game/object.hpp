@@ -5,6 +5,9 @@
 #include <unordered_map>
 #include <vector>
 #include <functional>
+#include <type_traits>
+
+#include "entity.hpp"
 
 // Declare a getter function
 #define SG_DECL_GET(type, name) \
@@ -50,6 +53,12 @@
         obj->set_##name(__VA_ARGS__); \
     }
 
+// Queue a call to the setter on the write job, to be made during the write cycle.
+// Intended for jobs that would otherwise collide with readers of the object.
+#define SG_QUEUE_SET(obj, name, ...) \
+    ::game::world::instance()->write_job->set( \
+        *(obj), &std::remove_cvref_t<decltype(*(obj))>::set_##name, __VA_ARGS__)
+
 namespace game {
     // This represents the most abstract form of an object. It is intended to be
     // used as a base class for all objects in the game.
@@ -61,6 +70,11 @@ namespace game {
         // of a hierarchy of objects.
         std::vector<std::shared_ptr<object>> _children{};
 
+        // The ECS entity that holds the object's simulation state, if any. This
+        // lets objects in the tree front large amounts of entities that systems
+        // stream through, such as units.
+        ecs::entity _entity{};
+
     public:
         object(const std::string_view name) : _name(name) {}
 
@@ -93,5 +107,12 @@ namespace game {
 
         // Find first child of name in the children.
         [[nodiscard]] object& find_child(const std::string_view name) const;
+
+        // Get the ECS entity the object refers to. It is null if there is none.
+        SG_IMPL_GET_WRAP(entity)
+
+        // Set the ECS entity the object refers to. The entity lives in the
+        // world's registry.
+        SG_IMPL_SET_WRAP(entity)
     };
 }
\ No newline at end of file
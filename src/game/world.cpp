@@ -1,6 +1,7 @@
 #include "world.hpp"
 #include "SDL.h"
 #include "SDL_video.h"
+#include "ecs.hpp"
 #include "object.hpp"
 #include "util/logger.hpp"
 #include "write_job.hpp"
@@ -10,6 +11,7 @@
 #include "event_pump.hpp"
 #include "rendering/render_job.hpp"
 #include <cerrno>
+#include <cmath>
 
 namespace game {
     std::shared_ptr<world>& world::instance() {
@@ -24,17 +26,32 @@ namespace game {
         // Initialize the scheduler
         scheduler = std::make_shared<sched::runner>();
 
+        // Initialize the entity registry
+        entities = std::make_shared<ecs::registry>();
+
         // Initialize the write job and schedule it
+        // It writes the object tree, so every job that reads objects waits on
+        // it. The renderer does, so it has to make the frame as well.
         write_job = std::make_shared<game::write_job>();
+        write_job->set_priority(sched::job_priority::critical);
+        write_job->writes<game::object>();
         scheduler->schedule(write_job);
 
         // Initialize the event pump and schedule it
         event_pump = std::make_shared<game::event_pump>();
         scheduler->schedule(event_pump);
 
-        // Initialize the renderer
+        // Initialize the renderer, unless there is nothing to render to
+        if (headless)
+            return;
+
         render_job = std::make_shared<rendering::render_job>("Viewport", glm::vec2{800, 600 });
-        write_job->schedule(render_job);
+        render_job->set_priority(sched::job_priority::critical);
+
+        // SDL wants the window to be used from the thread that created it
+        render_job->pin_to_main();
+        render_job->reads<game::object>();
+        scheduler->schedule(render_job);
     }
 
     void world::set_fps(int fps) {
@@ -42,6 +59,12 @@ namespace game {
 
         // Match refresh rate of monitor if fps is 0
         // Also prevents division by zero
+        if (fps == 0 && headless) {
+            // There is no monitor to match
+            scheduler->frame_delay = 1.0 / 60;
+            return;
+        }
+
         if (fps == 0) {
             // Check video init in SDL and initialize if not
             // This is required to get the refresh rate of the monitor
@@ -71,6 +94,15 @@ namespace game {
         return static_cast<int>(1.0 / scheduler->frame_delay);
     }
 
+    int world::get_tick_rate() {
+        const auto tick_delay = scheduler->tick_delay.load();
+        return tick_delay > 0 ? static_cast<int>(std::lround(1.0 / tick_delay)) : 0;
+    }
+
+    void world::set_tick_rate(int rate) {
+        scheduler->tick_delay = rate > 0 ? 1.0 / rate : 0.0;
+    }
+
     void world::start(bool floating) {
         scheduler->start(floating);
     }
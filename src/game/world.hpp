@@ -15,6 +15,11 @@ namespace rendering {
     class render_job;
 }
 
+// Forward declarations
+namespace game::ecs {
+    class registry;
+}
+
 namespace game {
     // Forward declarations
     class write_job;
@@ -31,8 +36,15 @@ namespace game {
 
         std::shared_ptr<game::event_pump> event_pump;
 
+        // Storage for entities that are too numerous for the object tree
+        std::shared_ptr<ecs::registry> entities;
+
         std::shared_ptr<game::event<char>> key_down = std::make_shared<game::event<char>>();
 
+        // Run without a window or renderer, for benchmarking the scheduler and
+        // game logic. Must be set before the instance is first created.
+        static inline bool headless{ false };
+
         // Returns the singleton instance of the world
         static std::shared_ptr<world>& instance();
 
@@ -41,9 +53,18 @@ namespace game {
         // Get the maximum framerate of the game's scheduler
         int get_fps();
 
-        // Set the maximum framerate of the game's scheduler
+        // Set the maximum framerate of the game's scheduler. 0 matches the
+        // refresh rate of the monitor, or 60 when headless.
         void set_fps(int fps);
 
+        // Get the rate of the simulation lane in steps per second, or 0 if it
+        // runs once per frame
+        int get_tick_rate();
+
+        // Set the rate of the simulation lane in steps per second. 0 makes it
+        // run once per frame.
+        void set_tick_rate(int rate);
+
         // Start the scheduler. Refer to sched::runner::start for more information.
         void start(bool floating = false);
 
@@ -1,23 +1,269 @@
 #include "write_job.hpp"
 #include "object.hpp"
 
+#include <algorithm>
+#include <functional>
+#include <memory_resource>
+#include <unordered_map>
+
+#include "sched/parallel.hpp"
+
 namespace game {
+    namespace {
+        // Hands out a serial to every write job, so a thread never mistakes a new
+        // write job for one that was destroyed at the same address
+        std::atomic<std::uint64_t> serial_counter{ 1 };
+
+        // The buffers the calling thread last queued into, and which write job
+        // they belong to. Giving them up once the thread exits lets a new thread
+        // take them over instead of piling up buffers as workers come and go.
+        struct cached_buffers {
+            std::uint64_t serial{};
+            std::shared_ptr<write_job::thread_buffers> buffers{};
+
+            ~cached_buffers() {
+                if (buffers != nullptr)
+                    buffers->claimed.store(false, std::memory_order_release);
+            }
+        };
+
+        thread_local cached_buffers cached{};
+
+        // The amount of writes the parallel write phase aims to give each piece
+        constexpr std::size_t writes_per_piece = 64;
+
+        // Apply a command, or only destroy it if it was superseded. An exception
+        // is kept rather than let through, so the writes after it are still made
+        // and every command is destroyed.
+        void apply_command(command_buffer::command& queued, std::exception_ptr& error) noexcept {
+            try {
+                queued.apply(queued, !queued.superseded);
+            }
+            catch (...) {
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+    }
+
+    write_job::write_job() : _serial(serial_counter.fetch_add(1, std::memory_order_relaxed)) {}
+
+    write_job::thread_buffers& write_job::local() {
+        if (cached.serial == _serial)
+            return *cached.buffers;
+
+        // The thread last queued into another write job, so let go of its buffers
+        if (cached.buffers != nullptr)
+            cached.buffers->claimed.store(false, std::memory_order_release);
+
+        std::lock_guard lock{ _threads_mutex };
+
+        // Take over the buffers of a thread that has exited, if there are any
+        std::shared_ptr<thread_buffers> found{};
+        for (const auto& buffers : _threads) {
+            auto expected = false;
+            if (buffers->claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                found = buffers;
+                break;
+            }
+        }
+
+        if (found == nullptr) {
+            found = std::make_shared<thread_buffers>();
+            _threads.push_back(found);
+        }
+
+        cached.serial = _serial;
+        cached.buffers = std::move(found);
+        return *cached.buffers;
+    }
+
+    bool write_job::collect() {
+        _applying.clear();
+
+        std::lock_guard lock{ _threads_mutex };
+        std::unique_lock swap_lock{ _swap_mutex };
+        for (const auto& buffers : _threads) {
+            // Every pass empties the buffers it applies, so the thread can start
+            // appending to the other one
+            buffers->back ^= 1;
+
+            auto& front = buffers->buffers[buffers->back ^ 1];
+            if (!front.empty())
+                _applying.push_back(&front);
+        }
+
+        return !_applying.empty();
+    }
+
+    void write_job::coalesce(const std::span<command_buffer::command* const> order) {
+        using command = command_buffer::command;
+
+        // Setter calls are the same property if they target the same object and
+        // call the same setter. Calls with different apply functions call setters
+        // of different types, so they are never compared. An object only has a
+        // handful of setters, so hashing the object alone is enough.
+        struct property_hash {
+            std::size_t operator()(const command* queued) const noexcept {
+                return std::hash<const void*>{}(queued->target);
+            }
+        };
+
+        struct same_property {
+            bool operator()(const command* a, const command* b) const noexcept {
+                return a->target == b->target && a->apply == b->apply && a->same_property(*a, *b);
+            }
+        };
+
+        // The latest call to every setter since the last closure that could see
+        // it, along with how many closures on its object had been queued by then.
+        // These only live for this pass, so they come out of the frame arena.
+        std::pmr::unordered_map<command*, std::pair<command*, std::uint64_t>, property_hash, same_property> latest{
+            &sched::frame_memory()
+        };
+        std::pmr::unordered_map<const void*, std::uint64_t> closures{ &sched::frame_memory() };
+
+        for (const auto queued : order) {
+            // A closure without a target could read any object
+            if (queued->target == nullptr) {
+                latest.clear();
+                closures.clear();
+                continue;
+            }
+
+            // A closure on an object could read any of its properties
+            if (queued->same_property == nullptr) {
+                closures[queued->target]++;
+                continue;
+            }
+
+            const auto closure = closures.find(queued->target);
+            const auto seen = closure != closures.end() ? closure->second : 0;
+            const auto [found, inserted] = latest.try_emplace(queued, queued, seen);
+            if (inserted)
+                continue;
+
+            // Only drop the earlier call if nothing could have seen its value
+            auto& [last, last_seen] = found->second;
+            if (last_seen == seen) {
+                last->superseded = true;
+                _stats.coalesced++;
+            }
+
+            last = queued;
+            last_seen = seen;
+        }
+    }
+
+    void write_job::apply() {
+        using command = command_buffer::command;
+
+        std::size_t size = 0;
+        std::size_t properties = 0;
+        for (const auto buffer : _applying) {
+            size += buffer->size();
+            properties += buffer->properties();
+        }
+
+        // Each buffer is in order already, so merging them by the head of each
+        // restores the order the writes were queued in. There are only as many
+        // buffers as threads, so a linear scan for the earliest is enough.
+        std::pmr::vector<command*> order{ &sched::frame_memory() };
+        order.reserve(size);
+        while (true) {
+            command_buffer* earliest = nullptr;
+            for (const auto buffer : _applying) {
+                if (!buffer->empty() && (earliest == nullptr || buffer->front()->sequence < earliest->front()->sequence))
+                    earliest = buffer;
+            }
+
+            if (earliest == nullptr)
+                break;
+
+            const auto queued = earliest->take_front();
+            if (queued->same_property != nullptr)
+                _stats.property_writes++;
+
+            order.push_back(queued);
+        }
+        _stats.writes += order.size();
+
+        if (coalesce_writes && properties > 1)
+            coalesce(order);
+
+        // Writes that could touch more than their target split the order into
+        // runs. Each run is applied in parallel, then the write that ended it on
+        // its own.
+        std::exception_ptr error{};
+        auto run = order.begin();
+        for (auto queued = order.begin(); queued != order.end(); ++queued) {
+            if ((*queued)->parallel)
+                continue;
+
+            apply_targeted({ run, queued }, error);
+            apply_command(**queued, error);
+            run = queued + 1;
+        }
+        apply_targeted({ run, order.end() }, error);
+
+        for (const auto buffer : _applying)
+            buffer->release();
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    void write_job::apply_targeted(const std::span<command_buffer::command*> commands, std::exception_ptr& error) {
+        if (commands.size() < parallel_threshold) {
+            for (const auto queued : commands)
+                apply_command(*queued, error);
+            return;
+        }
+
+        // Group the writes by object. Sequences are unique, so sorting by them
+        // within each object keeps its writes in order without a stable sort.
+        std::ranges::sort(commands, [](const auto* a, const auto* b) {
+            if (a->target != b->target)
+                return std::less<const void*>{}(a->target, b->target);
+            return a->sequence < b->sequence;
+        });
+
+        std::pmr::vector<std::size_t> groups{ &sched::frame_memory() };
+        for (std::size_t i = 0; i < commands.size(); i++) {
+            if (i == 0 || commands[i]->target != commands[i - 1]->target)
+                groups.push_back(i);
+        }
+        groups.push_back(commands.size());
+
+        // Pieces are whole objects, sized to hold about the same amount of writes
+        const auto objects = groups.size() - 1;
+        const auto grain = std::max<std::size_t>(objects * writes_per_piece / commands.size(), 1);
+
+        std::mutex error_mutex{};
+        sched::parallel_for({ 0, objects }, grain, [&](const sched::range& piece) {
+            std::exception_ptr piece_error{};
+            for (auto i = groups[piece.begin]; i < groups[piece.end]; i++)
+                apply_command(*commands[i], piece_error);
+
+            if (piece_error) {
+                std::lock_guard lock{ error_mutex };
+                if (!error)
+                    error = piece_error;
+            }
+        });
+    }
+
     void write_job::execute() {
         // Acquire a write lock to ensure no other threads can
         // read or write to the object properties and cause a
         // data race. Single lock is done here for efficiency
         // (concurrent R/W is rare in this case).
         std::lock_guard lock(mutex);
+        _stats = {};
 
-        // Empty the queue and execute all pending functions
-        std::unique_ptr<std::function<void()>> pfn;
-        while (queue.try_pop(pfn)) {
-            (*pfn)();
-            // RAII should take care of the rest
-        }
-    }
-
-    void write_job::enqueue(std::function<void()>&& fn) {
-        queue.push(std::make_unique<std::function<void()>>(std::move(fn)));
+        // Apply everything queued so far in one pass, then anything the writes
+        // queued themselves
+        while (collect())
+            apply();
     }
 }
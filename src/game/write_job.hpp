@@ -1,8 +1,17 @@
 #pragma once
 
-#include <functional>
-#include <tbb/concurrent_queue.h>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "command_buffer.hpp"
 #include "sched/job.hpp"
 
 // I settled with a little messier solution than the one i had in mind, but it works.
@@ -22,11 +31,78 @@ namespace game {
     // colliding with object information during a write and causing all sorts of nasty
     // bugs.
     class write_job final : public sched::job {
-        // A list of functions to be invoked by the write job. These functions are to
-        // write to the object.
-        // By the way i wrapped this in a smart pointer because std::function doesn't
-        // work well with the concurrent queue.
-        tbb::concurrent_queue<std::unique_ptr<std::function<void()>>> queue;
+    public:
+        // What the write job did in its last run
+        struct write_stats {
+            // The amount of writes taken off the buffers, applied or not
+            std::size_t writes{};
+
+            // The amount of those that were setter calls
+            std::size_t property_writes{};
+
+            // The amount of setter calls dropped because a later call to the same
+            // setter on the same object made them redundant
+            std::size_t coalesced{};
+        };
+
+        // The command buffers of one thread. The thread appends to one while the
+        // write job applies the other.
+        struct thread_buffers {
+            command_buffer buffers[2];
+            std::uint32_t back{ 0 };
+
+            // Determines if a thread owns the buffers. Buffers of threads that have
+            // exited are handed to the next new thread.
+            std::atomic<bool> claimed{ true };
+        };
+
+    private:
+        // Identifies the write job to the threads that cache their buffers
+        std::uint64_t _serial;
+
+        // Orders every queued write across threads, so writes made one after
+        // another on different workers are still applied in that order
+        std::atomic<std::uint64_t> _sequence{ 0 };
+
+        // Held shared while a thread numbers and appends a write, and exclusively
+        // while the buffers are swapped. Every write that misses a swap is then
+        // numbered after every write that made it, so a later write can never be
+        // applied a frame before an earlier one.
+        std::shared_mutex _swap_mutex{};
+
+        // The buffers of every thread that has queued a write
+        std::mutex _threads_mutex{};
+        std::vector<std::shared_ptr<thread_buffers>> _threads{};
+
+        // The buffers being applied, collected at the start of each pass
+        std::vector<command_buffer*> _applying{};
+
+        // The statistics of the last run, only touched while holding the mutex
+        write_stats _stats{};
+
+        // Get the buffers of the calling thread, registering them on first use
+        thread_buffers& local();
+
+        // Swap the buffers of every thread and collect the ones to apply.
+        // Returns false if nothing was queued.
+        bool collect();
+
+        // Mark every setter call that is followed by a later call to the same
+        // setter on the same object, with no closure that could see the object
+        // in between, so only the last value is applied. Takes the writes in
+        // order of queueing.
+        void coalesce(std::span<command_buffer::command* const> order);
+
+        // Apply the collected buffers, merged back into the order of queueing.
+        // Runs of commands that only touch their target are applied in parallel,
+        // one object per piece, while the rest are applied on their own.
+        // A write that throws doesn't stop the others, and the first exception
+        // is rethrown once every write has been made.
+        void apply();
+
+        // Apply a run of commands that may be applied in parallel, spreading the
+        // objects over the workers once there are enough of them
+        void apply_targeted(std::span<command_buffer::command*> commands, std::exception_ptr& error);
 
     public:
         // The presence of this mutex is a precautionary measure. While reads and writes are currently
@@ -35,10 +111,71 @@ namespace game {
         // preventing potential data races.
         std::mutex mutex{};
 
+        // Determines if redundant setter calls are dropped. When several calls to
+        // the same setter on the same object are queued in a row, only the last
+        // one is made, at the point where it was queued. A closure without a
+        // target, or one on the same object, ends the row, so closures always see
+        // every write queued before them.
+        bool coalesce_writes{ true };
+
+        // The amount of parallel writes in a row below which they are applied
+        // on the write job's own worker, as spreading them over the workers would
+        // cost more than it saves
+        std::size_t parallel_threshold{ 256 };
+
+        write_job();
+
+        // Get what the write job did in its last run. Safe to be called from jobs
+        // that read objects, which run after the write job, or while holding the
+        // mutex.
+        [[nodiscard]] write_stats stats() const { return _stats; }
+
         // Ran by the scheduler to execute the queued functions.
         void execute() override;
 
-        // Enqueue a function to be called during the write cycle.
-        void enqueue(std::function<void()>&& fn);
+        // Enqueue a function to be called during the write cycle. The function is
+        // stored in the calling thread's command buffer without allocating.
+        // Functions queued like this could write to anything, so they are called
+        // on their own, after every write queued before them.
+        template <class Fn>
+        void enqueue(Fn&& fn) {
+            auto& buffers = local();
+            std::shared_lock lock{ _swap_mutex };
+            buffers.buffers[buffers.back].push(_sequence.fetch_add(1, std::memory_order_relaxed), nullptr,
+                                           std::forward<Fn>(fn));
+        }
+
+        // Enqueue a function that only touches the target object. It may be
+        // called in parallel with writes to other objects, but still in order
+        // with every other write to the target.
+        template <class T, class Fn>
+        void enqueue(T& target, Fn&& fn) {
+            auto& buffers = local();
+            std::shared_lock lock{ _swap_mutex };
+            buffers.buffers[buffers.back].push(_sequence.fetch_add(1, std::memory_order_relaxed),
+                                           static_cast<void*>(std::addressof(target)), std::forward<Fn>(fn));
+        }
+
+        // Enqueue a call to a setter of an object, such as one implemented with
+        // SG_IMPL_SET, to be made during the write cycle. Setters may reach past
+        // their object, to shared caches for example, so the call is made on its
+        // own like a function without a target.
+        template <class T, class V, class U>
+        void set(std::type_identity_t<T>& target, void (T::*setter)(V), U&& value) {
+            auto& buffers = local();
+            std::shared_lock lock{ _swap_mutex };
+            buffers.buffers[buffers.back].push(_sequence.fetch_add(1, std::memory_order_relaxed), target, false,
+                                           setter, std::forward<U>(value));
+        }
+
+        // Like set, but for setters that touch nothing but their object, which
+        // may then be called in parallel with writes to other objects
+        template <class T, class V, class U>
+        void set_parallel(std::type_identity_t<T>& target, void (T::*setter)(V), U&& value) {
+            auto& buffers = local();
+            std::shared_lock lock{ _swap_mutex };
+            buffers.buffers[buffers.back].push(_sequence.fetch_add(1, std::memory_order_relaxed), target, true,
+                                           setter, std::forward<U>(value));
+        }
     };
 }
@@ -15,12 +15,69 @@
 #include "util/uri_tools.hpp"
 #include "util/logger.hpp"
 
+#include <algorithm>
 #include <stdexcept>
 #include <csignal>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <string_view>
 #include <thread>
+#include <vector>
+
+// Options given on the command line
+struct launch_options {
+	// Run without a window or renderer
+	bool headless{ false };
+
+	// Run exactly this many frames uncapped and exit, or 0 to run until closed
+	std::uint64_t frames{ 0 };
+};
+
+launch_options parse_options(int argc, char* argv[]) {
+	launch_options options{};
+
+	for (auto i = 1; i < argc; i++) {
+		const std::string_view arg{ argv[i] };
+
+		if (arg == "--headless")
+			options.headless = true;
+		else if (arg == "--frames" && i + 1 < argc)
+			options.frames = std::strtoull(argv[++i], nullptr, 10);
+		else
+			util::log::send(util::log_level::warning, "Unknown argument: {}", arg);
+	}
+
+	return options;
+}
+
+// Print the execution time of every frame followed by a summary, in milliseconds
+void report_frame_times(const std::vector<double>& frame_times) {
+	if (frame_times.empty())
+		return;
+
+	for (std::size_t i = 0; i < frame_times.size(); i++)
+		std::cout << "frame " << i << ' ' << frame_times[i] * 1000.0 << " ms\n";
+
+	auto sorted = frame_times;
+	std::sort(sorted.begin(), sorted.end());
+
+	auto total = 0.0;
+	for (const auto time : sorted)
+		total += time;
+
+	// Use the same percentiles as the runner's jitter
+	const auto percentile = [&sorted](const double p) {
+		return sched::nearest_rank(sorted, p) * 1000.0;
+	};
+
+	std::cout << "frames " << sorted.size()
+		<< " mean " << total / static_cast<double>(sorted.size()) * 1000.0 << " ms"
+		<< " p50 " << percentile(0.5) << " ms"
+		<< " p99 " << percentile(0.99) << " ms"
+		<< " max " << sorted.back() * 1000.0 << " ms" << std::endl;
+}
 
 void exception_filter() {
 	const std::string msg = "An unhandled exception has occurred. The program will now exit.";
@@ -95,7 +152,8 @@ void exception_filter() {
 	platform::dump_and_exit();
 }
 
-void init_world() {
+void init_world(const launch_options& options) {
+	game::world::headless = options.headless;
 	auto world = game::world::instance();
 
 	// If we get an interrupt signal, we will stop the scheduler to allow for a graceful
@@ -110,12 +168,21 @@ void init_world() {
 
 	// Start the scheduler, which will also block this thread until the scheduler is
 	// gracefully stopped
-	world->set_fps(0);
+	if (options.frames > 0) {
+		// Benchmark run: no frame cap, stop after the requested amount of frames
+		world->scheduler->frame_delay = 0;
+		world->scheduler->frame_limit = options.frames;
+		world->scheduler->record_frame_times = true;
+	}
+	else
+		world->set_fps(0);
 	world->start();
 
 	// If we get here, the scheduler has been stopped (potentially by an interrupt signal)
 	// and we can safely exit
 	util::log::send(util::log_level::info, "Scheduler stop");
+
+	report_frame_times(world->scheduler->frame_times());
 }
 
 int main(int argc, char* argv[]) {
@@ -125,7 +192,7 @@ int main(int argc, char* argv[]) {
 	// Initialize the log system, and write to console if we are in debug mode
 	util::log::init(true);
 
-	init_world();
+	init_world(parse_options(argc, argv));
 
 	// This is the desired "normal" exit point of the program. Here, we clean up whatever
 	// may be left over and exit.
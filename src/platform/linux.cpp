@@ -10,37 +10,138 @@
 
 #include "linux.hpp"
 #include <sched.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
 #include <list>
 #include <csignal>
+#include <optional>
+#include <sstream>
+#include <tuple>
 #include <unordered_map>
 
 namespace platform {
-    void set_thread_affinity(std::thread& thread, const affinity_mask mask) {
-        // oh yeah jit go brrr and crash so i commented this out
-        
-        // Linux uses the same concept but they have to be different and use a struct for
-        // some reason, so we just do a cast.
+    namespace fs = std::filesystem;
+
+    // Parse a kernel CPU list such as "0-3,8,10-11"
+    static std::vector<std::uint32_t> parse_cpu_list(const std::string& list) {
+        std::vector<std::uint32_t> cpus{};
+        std::stringstream stream{ list };
+        std::string range;
+
+        while (std::getline(stream, range, ',')) {
+            if (range.empty() || !std::isdigit(static_cast<unsigned char>(range.front())))
+                continue;
+
+            const auto dash = range.find('-');
+            const auto first = static_cast<std::uint32_t>(std::stoul(range.substr(0, dash)));
+            const auto last = dash == std::string::npos
+                ? first
+                : static_cast<std::uint32_t>(std::stoul(range.substr(dash + 1)));
+
+            for (auto cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+        }
 
-        /*std::cout << "set: " << std::setfill('0') << std::setw(4) << std::hex << mask << std::endl;
+        return cpus;
+    }
 
-        cpu_set_t set_th;
+    // Read the first line of a sysfs file, or nothing if it can't be read
+    static std::optional<std::string> read_sysfs(const fs::path& path) {
+        std::ifstream file{ path };
+        std::string line;
+        if (!file || !std::getline(file, line))
+            return std::nullopt;
+        return line;
+    }
 
-        CPU_ZERO(&set_th);
-        pthread_getaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &set_th);
-        std::cout << "old: " << std::setfill('0') << std::setw(4) << std::hex << *reinterpret_cast<std::uintptr_t*>(&set_th) << std::endl;
+    // Identify a group of CPUs listed in a sysfs file by its lowest member
+    static std::optional<std::uint32_t> lowest_in_list(const fs::path& path) {
+        const auto list = read_sysfs(path);
+        if (!list.has_value())
+            return std::nullopt;
 
-        const auto set = *reinterpret_cast<const cpu_set_t*>(&mask);
-        if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &set) != 0)
-            throw std::runtime_error("Failed to set thread affinity");
+        const auto cpus = parse_cpu_list(*list);
+        if (cpus.empty())
+            return std::nullopt;
+        return *std::ranges::min_element(cpus);
+    }
 
-        CPU_ZERO(&set_th);
-        pthread_getaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &set_th);
-        std::cout << "new: " << std::setfill('0') << std::setw(4) << std::hex << *reinterpret_cast<std::uintptr_t*>(&set_th) << std::endl;
+    std::vector<cpu_info> cpu_topology() {
+        const fs::path cpu_root = "/sys/devices/system/cpu";
+        std::vector<cpu_info> cpus{};
+
+        // Only consider the CPUs in our cpuset. This is what taskset and cgroup
+        // cpusets restrict, and pinning outside of it would fail.
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+            const auto count = std::max(1u, std::thread::hardware_concurrency());
+            for (std::uint32_t i = 0; i < count; i++)
+                cpus.push_back({ i, i, 0, 0 });
+            return cpus;
+        }
+
+        for (std::uint32_t id = 0; id < CPU_SETSIZE; id++) {
+            if (!CPU_ISSET(id, &allowed))
+                continue;
+
+            const auto cpu_path = cpu_root / ("cpu" + std::to_string(id));
+
+            // SMT siblings share a core, and we name the core by its lowest sibling
+            cpu_info cpu{ id, id, 0, 0 };
+            cpu.core = lowest_in_list(cpu_path / "topology" / "thread_siblings_list").value_or(id);
+
+            // Default the cache domain to the package in case there is no L3
+            const auto package = read_sysfs(cpu_path / "topology" / "physical_package_id");
+            if (package.has_value() && !package->empty() && std::isdigit(static_cast<unsigned char>(package->front())))
+                cpu.cache = static_cast<std::uint32_t>(std::stoul(*package));
+
+            std::error_code ec;
+            for (const auto& index : fs::directory_iterator{ cpu_path / "cache", ec }) {
+                if (read_sysfs(index.path() / "level") != "3")
+                    continue;
+
+                // Offset cache IDs so they can't collide with package IDs
+                if (const auto lowest = lowest_in_list(index.path() / "shared_cpu_list"))
+                    cpu.cache = CPU_SETSIZE + *lowest;
+                break;
+            }
+
+            // The CPU directory links to the NUMA node it belongs to
+            for (const auto& entry : fs::directory_iterator{ cpu_path, ec }) {
+                const auto name = entry.path().filename().string();
+                if (name.size() > 4 && name.starts_with("node") && std::isdigit(static_cast<unsigned char>(name[4]))) {
+                    cpu.numa_node = static_cast<std::uint32_t>(std::stoul(name.substr(4)));
+                    break;
+                }
+            }
+
+            cpus.push_back(cpu);
+        }
 
-        // uh make sure the process can actually use the cores
-        //affinity_mask max_mask = 0xFFFFFFFFFFFFFFFF;
-        //auto max_set = *reinterpret_cast<cpu_set_t*>(&max_mask);
-        //sched_setaffinity(getpid(), sizeof(cpu_set_t), &max_set);*/
+        std::ranges::sort(cpus, {}, [](const cpu_info& cpu) {
+            return std::tuple{ cpu.numa_node, cpu.cache, cpu.core, cpu.id };
+        });
+        return cpus;
+    }
+
+    void set_thread_affinity(std::thread& thread, const affinity_mask& mask) {
+        // Linux uses the same concept but they have to be different and use a struct for
+        // some reason, so we copy the bits over.
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (std::size_t cpu = 0; cpu < mask.size(); cpu++) {
+            if (mask.test(cpu))
+                CPU_SET(cpu, &set);
+        }
+
+        if (pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) != 0)
+            throw std::runtime_error("Failed to set thread affinity");
     }
 
     // This is a workaround for the fact that std::signal does not support passing
@@ -61,6 +162,42 @@ namespace platform {
 
     std::unordered_map<int, signal_handler> signal_dispatcher::callbacks;
 
+    frame_timer::frame_timer() {
+        // steady_clock is backed by CLOCK_MONOTONIC
+        _fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    }
+
+    frame_timer::~frame_timer() {
+        if (_fd != -1)
+            close(_fd);
+    }
+
+    void frame_timer::wait_until(const std::chrono::steady_clock::time_point deadline) {
+        const auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+        if (since_epoch <= 0)
+            return;
+
+        timespec time{};
+        time.tv_sec = static_cast<time_t>(since_epoch / 1'000'000'000);
+        time.tv_nsec = static_cast<long>(since_epoch % 1'000'000'000);
+
+        // Without a timer, clock_nanosleep offers the same absolute deadline
+        if (_fd == -1) {
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, nullptr) == EINTR) {}
+            return;
+        }
+
+        itimerspec spec{};
+        spec.it_value = time;
+        if (timerfd_settime(_fd, TFD_TIMER_ABSTIME, &spec, nullptr) == -1)
+            return;
+
+        // The read blocks until the timer expires, or returns right away if the
+        // deadline has already passed
+        std::uint64_t expirations;
+        while (read(_fd, &expirations, sizeof(expirations)) == -1 && errno == EINTR) {}
+    }
+
     void on_close(signal_handler callback) {
         signal_dispatcher::handle(SIGINT, std::move(callback));
         signal_dispatcher::handle(SIGTERM, std::move(callback));
@@ -2,15 +2,59 @@
 
 #if defined(__linux__)
 
+#include <bitset>
+#include <chrono>
 #include <functional>
+#include <string>
 #include <thread>
+#include <vector>
 #include <cstdint>
 
+#include <sched.h>
+
 namespace platform {
-    // Size of word
-    using affinity_mask = std::uintptr_t;
+    // One bit per logical CPU. An empty mask lets the OS decide.
+    // Sized to match cpu_set_t so machines with more than 64 CPUs can be described.
+    using affinity_mask = std::bitset<CPU_SETSIZE>;
+
+    // Describes where a logical CPU sits in the machine
+    struct cpu_info {
+        // The logical CPU number used by the OS
+        std::uint32_t id;
+
+        // Identifies the physical core. SMT siblings share this value.
+        std::uint32_t core;
+
+        // Identifies the last level (L3) cache domain, such as a CCX
+        std::uint32_t cache;
+
+        // The NUMA node the CPU belongs to
+        std::uint32_t numa_node;
+    };
+
+    // Discover the logical CPUs this process is allowed to run on (honoring the
+    // process cpuset), sorted so CPUs that share a NUMA node, cache and core are
+    // adjacent
+    std::vector<cpu_info> cpu_topology();
+
+    void set_thread_affinity(std::thread& thread, const affinity_mask& mask);
+
+    // Sleeps until absolute deadlines on the monotonic clock using a timerfd
+    // Waking at an absolute time avoids the overshoot of a relative sleep adding up.
+    class frame_timer {
+        // The timer descriptor, or -1 if it could not be created
+        int _fd;
+
+    public:
+        frame_timer();
+        ~frame_timer();
+
+        frame_timer(const frame_timer&) = delete;
+        frame_timer& operator=(const frame_timer&) = delete;
 
-    void set_thread_affinity(std::thread& thread, const affinity_mask mask);
+        // Block until the deadline has passed. Returns right away if it already has.
+        void wait_until(std::chrono::steady_clock::time_point deadline);
+    };
 
     using signal_handler = std::function<void(int)>;
     void on_close(signal_handler callback);
@@ -2,14 +2,103 @@
 
 #include "windows.hpp"
 
+#include <algorithm>
 #include <stdexcept>
+#include <tuple>
 
 namespace platform {
-    void set_thread_affinity(std::thread& thread, const affinity_mask mask) {
-        if (!SetThreadAffinityMask(thread.native_handle(), mask))
+    // Get the index of the lowest CPU in a processor mask, used as a group ID
+    static std::uint32_t lowest_cpu(const ULONG_PTR mask) {
+        for (std::uint32_t i = 0; i < sizeof(ULONG_PTR) * 8; i++) {
+            if (mask & (static_cast<ULONG_PTR>(1) << i))
+                return i;
+        }
+        return 0;
+    }
+
+    std::vector<cpu_info> cpu_topology() {
+        // Honor the affinity the process was started with
+        DWORD_PTR process_mask{}, system_mask{};
+        if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+            process_mask = ~static_cast<DWORD_PTR>(0);
+
+        DWORD length = 0;
+        GetLogicalProcessorInformation(nullptr, &length);
+        std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> entries(
+            length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+
+        std::vector<cpu_info> cpus{};
+        if (entries.empty() || !GetLogicalProcessorInformation(entries.data(), &length)) {
+            // Fall back to a flat topology
+            const auto count = std::max(1u, std::thread::hardware_concurrency());
+            for (std::uint32_t i = 0; i < count; i++)
+                cpus.push_back({ i, i, 0, 0 });
+            return cpus;
+        }
+
+        // Every CPU starts out as its own core in a single domain
+        for (std::uint32_t i = 0; i < sizeof(DWORD_PTR) * 8; i++) {
+            if (process_mask & (static_cast<DWORD_PTR>(1) << i))
+                cpus.push_back({ i, i, 0, 0 });
+        }
+
+        // Each relationship entry lists the CPUs that share the resource
+        for (const auto& entry : entries) {
+            const auto group = lowest_cpu(entry.ProcessorMask);
+            for (auto& cpu : cpus) {
+                if (!(entry.ProcessorMask & (static_cast<ULONG_PTR>(1) << cpu.id)))
+                    continue;
+
+                if (entry.Relationship == RelationProcessorCore)
+                    cpu.core = group;
+                else if (entry.Relationship == RelationCache && entry.Cache.Level == 3)
+                    cpu.cache = group;
+                else if (entry.Relationship == RelationNumaNode)
+                    cpu.numa_node = entry.NumaNode.NodeNumber;
+            }
+        }
+
+        std::ranges::sort(cpus, {}, [](const cpu_info& cpu) {
+            return std::tuple{ cpu.numa_node, cpu.cache, cpu.core, cpu.id };
+        });
+        return cpus;
+    }
+
+    void set_thread_affinity(std::thread& thread, const affinity_mask& mask) {
+        if (!SetThreadAffinityMask(thread.native_handle(), static_cast<DWORD_PTR>(mask.to_ullong())))
             throw std::runtime_error("Failed to set thread affinity");
     }
 
+    frame_timer::frame_timer() {
+        // High resolution timers are only available since Windows 10 1803
+        _timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (_timer == nullptr)
+            _timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+    }
+
+    frame_timer::~frame_timer() {
+        if (_timer != nullptr)
+            CloseHandle(_timer);
+    }
+
+    void frame_timer::wait_until(const std::chrono::steady_clock::time_point deadline) {
+        const auto remaining = deadline - std::chrono::steady_clock::now();
+        if (remaining <= std::chrono::steady_clock::duration::zero())
+            return;
+
+        // Waitable timers can't use the steady clock's epoch, so the deadline
+        // is converted to a relative due time (negative, in 100ns units)
+        const auto ticks = std::chrono::duration_cast<std::chrono::duration<LONGLONG, std::ratio<1, 10'000'000>>>(remaining).count();
+        LARGE_INTEGER due_time{};
+        due_time.QuadPart = -std::max<LONGLONG>(ticks, 1);
+
+        if (_timer == nullptr || !SetWaitableTimer(_timer, &due_time, 0, nullptr, nullptr, FALSE)) {
+            std::this_thread::sleep_until(deadline);
+            return;
+        }
+        WaitForSingleObject(_timer, INFINITE);
+    }
+
     std::string executable_path() {
         std::string path_str(MAX_PATH, '\0');
         const auto path_len = GetModuleFileNameA(nullptr, path_str.data(), MAX_PATH);
@@ -2,8 +2,13 @@
 
 #if defined(_WIN32)
 
+#include <bitset>
+#include <chrono>
+#include <cstdint>
 #include <functional>
+#include <string>
 #include <thread>
+#include <vector>
 
 #define WIN32_LEAN_AND_MEAN
 #    include <Windows.h>
@@ -14,9 +19,47 @@
 #undef max
 
 namespace platform {
-	using affinity_mask = DWORD_PTR;
+	// One bit per logical CPU. An empty mask lets the OS decide.
+	// Thread affinity is limited to the processor group, which holds up to 64 CPUs.
+	using affinity_mask = std::bitset<sizeof(DWORD_PTR) * 8>;
 
-	void set_thread_affinity(std::thread& thread, affinity_mask mask);
+	// Describes where a logical CPU sits in the machine
+	struct cpu_info {
+		// The logical CPU number used by the OS
+		std::uint32_t id;
+
+		// Identifies the physical core. SMT siblings share this value.
+		std::uint32_t core;
+
+		// Identifies the last level (L3) cache domain, such as a CCX
+		std::uint32_t cache;
+
+		// The NUMA node the CPU belongs to
+		std::uint32_t numa_node;
+	};
+
+	// Discover the logical CPUs this process is allowed to run on, sorted so CPUs
+	// that share a NUMA node, cache and core are adjacent
+	std::vector<cpu_info> cpu_topology();
+
+	void set_thread_affinity(std::thread& thread, const affinity_mask& mask);
+
+	// Sleeps until deadlines on the monotonic clock using a high resolution
+	// waitable timer
+	class frame_timer {
+		// The timer handle, or null if it could not be created
+		HANDLE _timer;
+
+	public:
+		frame_timer();
+		~frame_timer();
+
+		frame_timer(const frame_timer&) = delete;
+		frame_timer& operator=(const frame_timer&) = delete;
+
+		// Block until the deadline has passed. Returns right away if it already has.
+		void wait_until(std::chrono::steady_clock::time_point deadline);
+	};
 
 	using signal_handler = std::function<void(int)>;
     inline void on_close(signal_handler callback) {}
@@ -93,6 +93,7 @@ namespace rendering {
             init(); // Required to init here since SDL requires the thread to be the same as the one that created the window
             _initialized = true;
         }
+        _alpha = worker()->runner()->alpha();
         poll_events();
         present();
     }
@@ -27,6 +27,9 @@ namespace rendering {
 
 		bool _initialized{};
 
+		// How far this frame is between the last two simulation steps
+		double _alpha{ 1.0 };
+
 		void init();
 
 		static void poll_events();
@@ -48,6 +51,10 @@ namespace rendering {
 			return renderer();
 		}
 
+		// Get how far the frame being rendered is between the previous and the
+		// latest simulation step, for interpolating simulated state
+		[[nodiscard]] double alpha() const { return _alpha; }
+
 		void add_renderable(const std::shared_ptr<renderable>& renderable);
 
 		void execute() override;
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#   include <immintrin.h>
+#endif
+
+namespace sched {
+    // Hint to the processor that we are in a spin loop. This frees up execution
+    // resources for the sibling hyper-thread and saves power.
+    inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+        _mm_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
+
+    // Adaptive spin state owned by a single waiting thread
+    // The budget grows when spinning pays off and shrinks when the thread ends up
+    // parking anyways, so threads that are woken quickly keep spinning while idle
+    // threads stop burning CPU.
+    class spinner {
+        // The amount of spins to attempt on the next wait
+        std::uint32_t _budget{ ~0u };
+
+    public:
+        // Spin until the predicate holds, giving up after the current budget.
+        // Returns true if the predicate was satisfied while spinning.
+        template <class Predicate>
+        bool spin(Predicate&& predicate, const std::uint32_t max_spins) {
+            // Never spin less than a fraction of the maximum so we keep probing
+            const auto min_spins = max_spins / 16;
+            _budget = std::clamp(_budget, min_spins, max_spins);
+
+            for (std::uint32_t i = 0; i < _budget; i++) {
+                if (predicate()) {
+                    _budget = _budget > max_spins / 2 ? max_spins : _budget * 2;
+                    return true;
+                }
+                cpu_relax();
+            }
+
+            _budget /= 2;
+            return predicate();
+        }
+    };
+
+    // Wait until the value differs from the old value, spinning before parking the
+    // thread on the atomic (a futex on Linux). Returns the new value.
+    template <class T>
+    T spin_wait(const std::atomic<T>& value, const T old, spinner& spinner, const std::uint32_t max_spins) {
+        const auto changed = [&] { return value.load(std::memory_order_acquire) != old; };
+
+        if (!spinner.spin(changed, max_spins))
+            value.wait(old, std::memory_order_acquire);
+
+        return value.load(std::memory_order_acquire);
+    }
+
+    // A counting barrier where a set amount of threads arrive and one thread waits
+    // for all of them. This replaces a mutex and condition variable per thread with
+    // a single atomic counter.
+    class barrier {
+        // The amount of threads that have yet to arrive
+        std::atomic<std::uint32_t> _remaining{ 0 };
+
+    public:
+        // Prepare the barrier for a new phase. This must not be called while
+        // threads of the previous phase may still arrive.
+        void reset(const std::uint32_t count) noexcept {
+            _remaining.store(count, std::memory_order_release);
+        }
+
+        // Report that the calling thread is done with the phase
+        void arrive() noexcept {
+            if (_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                _remaining.notify_all();
+        }
+
+        // Wait until every thread has arrived
+        void wait(spinner& spinner, const std::uint32_t max_spins) const {
+            const auto done = [this] { return _remaining.load(std::memory_order_acquire) == 0; };
+            if (spinner.spin(done, max_spins))
+                return;
+
+            // Park until the last thread arrives. The value may change many times
+            // before it reaches zero, so we have to keep re-checking.
+            auto remaining = _remaining.load(std::memory_order_acquire);
+            while (remaining != 0) {
+                _remaining.wait(remaining, std::memory_order_acquire);
+                remaining = _remaining.load(std::memory_order_acquire);
+            }
+        }
+    };
+}
@@ -0,0 +1,25 @@
+#include "budgeted_job.hpp"
+
+#include <chrono>
+#include <cmath>
+
+#include "worker.hpp"
+
+namespace sched {
+    void budgeted_job::execute() {
+        const auto budget = worker()->runner()->slice_budget();
+
+        // An unlimited budget never runs out
+        _slice_deadline = std::isfinite(budget)
+            ? runner::clock::now() + std::chrono::duration_cast<runner::clock::duration>(runner::duration(budget))
+            : runner::time_point::max();
+
+        _slices++;
+        if (run_slice(budget))
+            return;
+
+        // The work is done, the next slice starts a new piece of work
+        _last_slices = _slices;
+        _slices = 0;
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+#include "job.hpp"
+#include "runner.hpp"
+
+namespace sched {
+    // A job that spreads long work over several frames
+    // Every cycle, the job gets a slice of time to work in, based on how much of
+    // the frame is left. It keeps its own progress and reports whether there is
+    // more work pending, which is picked up again in the next cycle.
+    class budgeted_job : public job {
+        // The point in time the current slice should end by
+        runner::time_point _slice_deadline{};
+
+        // The amount of slices the work in progress has taken so far
+        std::uint32_t _slices{};
+
+        // The amount of slices the last finished piece of work took
+        std::uint32_t _last_slices{};
+
+    protected:
+        // Do as much work as fits in the budget, in seconds. Returns true if
+        // there is more work pending, or false once the work is done.
+        virtual bool run_slice(double budget) = 0;
+
+        // Determine if the current slice has used up its budget. Check this
+        // between units of work to stop in time.
+        [[nodiscard]] bool out_of_budget() const { return runner::clock::now() >= _slice_deadline; }
+
+    public:
+        // Run one slice of the work
+        void execute() final;
+
+        // Get the amount of slices the work in progress has taken so far
+        [[nodiscard]] std::uint32_t slices() const { return _slices; }
+
+        // Get the amount of slices the last finished piece of work took
+        [[nodiscard]] std::uint32_t last_slices() const { return _last_slices; }
+    };
+}
@@ -0,0 +1,78 @@
+#include "coroutine_job.hpp"
+
+#include <chrono>
+
+#include "worker.hpp"
+
+namespace sched {
+    bool coroutine_job::ready() {
+        switch (_waiting) {
+        case wait_kind::none:
+            return true;
+        case wait_kind::frame:
+            return worker()->runner()->frame() >= _resume_frame;
+        case wait_kind::time:
+            return runner::clock::now() >= _resume_time;
+        case wait_kind::wake:
+            return _woken.exchange(false, std::memory_order_acquire);
+        }
+        return true;
+    }
+
+    void coroutine_job::execute() {
+        // Create the body on the first execution, and attach ourselves to it so
+        // awaiters can find the job
+        if (!_started) {
+            _coroutine = body();
+            _coroutine.handle().promise().job = this;
+            _started = true;
+        }
+
+        const auto handle = _coroutine.handle();
+        if (handle.done() || !ready())
+            return;
+
+        // Run the body until it suspends or returns
+        _waiting = wait_kind::none;
+        handle.resume();
+
+        if (!handle.done())
+            return;
+
+        // The body is done, stop scheduling the job
+        exit();
+        if (const auto error = handle.promise().error)
+            std::rethrow_exception(error);
+    }
+
+    void coroutine_job::await_frame(const std::uint64_t frame) noexcept {
+        _waiting = wait_kind::frame;
+        _resume_frame = frame;
+    }
+
+    void coroutine_job::await_time(const runner::time_point time) noexcept {
+        _waiting = wait_kind::time;
+        _resume_time = time;
+    }
+
+    void coroutine_job::await_wake() noexcept {
+        // This is called before the awaiter hands out a way to wake us, so
+        // there can't be a wake for this wait yet
+        _waiting = wait_kind::wake;
+        _woken.store(false, std::memory_order_relaxed);
+    }
+
+    void coroutine_job::wake() noexcept {
+        _woken.store(true, std::memory_order_release);
+    }
+
+    void frame_awaiter::await_suspend(const coroutine::handle_type handle) const {
+        const auto job = handle.promise().job;
+        job->await_frame(job->worker()->runner()->frame() + frames);
+    }
+
+    void sleep_awaiter::await_suspend(const coroutine::handle_type handle) const noexcept {
+        const auto delay = std::chrono::duration_cast<runner::clock::duration>(runner::duration(seconds));
+        handle.promise().job->await_time(runner::clock::now() + delay);
+    }
+}
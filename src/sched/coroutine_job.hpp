@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <utility>
+
+#include "job.hpp"
+#include "runner.hpp"
+
+namespace sched {
+    // Forward declarations
+    class coroutine_job;
+
+    // The coroutine type returned by the body of a coroutine job
+    class coroutine {
+    public:
+        struct promise_type {
+            // The job the coroutine belongs to, set before the body starts
+            coroutine_job* job{};
+
+            // Exception thrown by the body, rethrown by the job
+            std::exception_ptr error{};
+
+            coroutine get_return_object() noexcept {
+                return coroutine{ std::coroutine_handle<promise_type>::from_promise(*this) };
+            }
+
+            // The body starts suspended so the job can attach itself first
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            // The frame is destroyed by the coroutine object, not on completion
+            std::suspend_always final_suspend() noexcept { return {}; }
+
+            void return_void() noexcept {}
+
+            void unhandled_exception() noexcept { error = std::current_exception(); }
+        };
+
+        using handle_type = std::coroutine_handle<promise_type>;
+
+    private:
+        handle_type _handle{};
+
+    public:
+        coroutine() = default;
+        explicit coroutine(const handle_type handle) : _handle(handle) {}
+
+        coroutine(coroutine&& other) noexcept : _handle(std::exchange(other._handle, {})) {}
+
+        coroutine& operator=(coroutine&& other) noexcept {
+            if (this != &other) {
+                if (_handle)
+                    _handle.destroy();
+                _handle = std::exchange(other._handle, {});
+            }
+            return *this;
+        }
+
+        ~coroutine() {
+            if (_handle)
+                _handle.destroy();
+        }
+
+        // Get the handle to the coroutine frame
+        [[nodiscard]] auto handle() const noexcept { return _handle; }
+    };
+
+    // A job whose body is a coroutine that can suspend across cycles
+    // While it is suspended, the job only checks if it can resume, so it never
+    // holds up a worker. It resumes in whichever worker runs it in the first cycle
+    // that it is allowed to, and exits once the body returns.
+    class coroutine_job : public job {
+        // What the body is waiting for
+        enum class wait_kind {
+            none,
+            frame,
+            time,
+            wake
+        };
+
+        // The body of the job, created on the first execution
+        coroutine _coroutine{};
+
+        // Determines if the body has been created
+        bool _started{ false };
+
+        // What the body is waiting for and until when
+        // Only touched by the worker executing the job
+        wait_kind _waiting{ wait_kind::none };
+        std::uint64_t _resume_frame{};
+        runner::time_point _resume_time{};
+
+        // Set by wake
+        std::atomic<bool> _woken{ false };
+
+        // Determine if the body may resume in this cycle
+        bool ready();
+
+    protected:
+        // The body of the job. Use co_await with next_frame(), sleep() or an
+        // awaitable such as an event to suspend it.
+        virtual coroutine body() = 0;
+
+    public:
+        // Resume the body if it is done waiting
+        void execute() final;
+
+        // Suspend the body until the given cycle number
+        // Called by awaiters only
+        void await_frame(std::uint64_t frame) noexcept;
+
+        // Suspend the body until the given point in time
+        // Called by awaiters only
+        void await_time(runner::time_point time) noexcept;
+
+        // Suspend the body until wake is called
+        // Called by awaiters only
+        void await_wake() noexcept;
+
+        // Let a body that is suspended with await_wake resume in the next cycle
+        // that runs the job. This is safe to be called from any thread.
+        void wake() noexcept;
+    };
+
+    // Awaitable that suspends a coroutine job for a number of cycles
+    struct frame_awaiter {
+        std::uint64_t frames{ 1 };
+
+        bool await_ready() const noexcept { return frames == 0; }
+        void await_suspend(coroutine::handle_type handle) const;
+        void await_resume() const noexcept {}
+    };
+
+    // Awaitable that suspends a coroutine job for an amount of time
+    struct sleep_awaiter {
+        double seconds{};
+
+        bool await_ready() const noexcept { return seconds <= 0; }
+        void await_suspend(coroutine::handle_type handle) const noexcept;
+        void await_resume() const noexcept {}
+    };
+
+    // Resume the coroutine job in the next cycle, or after the given amount of cycles
+    inline frame_awaiter next_frame(const std::uint64_t frames = 1) noexcept { return { frames }; }
+
+    // Resume the coroutine job in the first cycle after the given amount of seconds
+    inline sleep_awaiter sleep(const double seconds) noexcept { return { seconds }; }
+}
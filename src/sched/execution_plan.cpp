@@ -0,0 +1,137 @@
+#include "execution_plan.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "job.hpp"
+
+namespace sched {
+    namespace {
+        // Determine if a job is somewhere under another in the tree
+        bool descends_from(const job& descendant, const job& ancestor) {
+            for (auto current = descendant.parent(); current != nullptr; current = current->parent()) {
+                if (current == &ancestor)
+                    return true;
+            }
+
+            return false;
+        }
+    }
+
+    void execution_plan::order_conflicts() {
+        // Only jobs that declared their accesses take part
+        std::vector<std::size_t> declared{};
+        for (std::size_t i = 0; i < _owned.size(); i++) {
+            const auto& job = *_owned[i];
+            if (!job._reads.empty() || !job._writes.empty())
+                declared.push_back(i);
+        }
+
+        // Every conflict is ordered by plan order, so the edges only ever point
+        // forward and the graph can't have a cycle. Jobs that are already
+        // ordered by the tree don't need an edge.
+        auto conflicts = false;
+        for (std::size_t a = 0; a < declared.size(); a++) {
+            const auto first = _owned[declared[a]].get();
+            for (auto b = a + 1; b < declared.size(); b++) {
+                const auto second = _owned[declared[b]].get();
+                if (!first->conflicts_with(*second) || descends_from(*second, *first))
+                    continue;
+
+                first->_followers.push_back(second);
+                second->_dependencies++;
+                conflicts = true;
+            }
+        }
+
+        if (!conflicts)
+            return;
+
+        // In sub-cycle mode, each job has to run in a later level than every job
+        // it waits on. Walking in plan order visits those jobs first.
+        std::unordered_map<const job*, std::size_t> levels{};
+        for (std::size_t level = 0; level + 1 < _level_offsets.size(); level++) {
+            for (auto i = _level_offsets[level]; i < _level_offsets[level + 1]; i++)
+                levels[_owned[i].get()] = level;
+        }
+
+        for (const auto& job : _owned) {
+            const auto level = levels[job.get()];
+            for (const auto successor : job->_successors)
+                levels[successor] = std::max(levels[successor], level + 1);
+            for (const auto follower : job->_followers)
+                levels[follower] = std::max(levels[follower], level + 1);
+        }
+
+        // Regroup the plan by level, keeping plan order within each level
+        std::ranges::stable_sort(_owned, {}, [&levels](const auto& job) { return levels[job.get()]; });
+
+        _level_offsets.clear();
+        for (std::size_t i = 0; i < _owned.size(); i++) {
+            while (_level_offsets.size() <= levels[_owned[i].get()])
+                _level_offsets.push_back(i);
+        }
+        _level_offsets.push_back(_owned.size());
+    }
+
+    void execution_plan::build(
+        const std::vector<std::shared_ptr<job>>& roots,
+        const std::uint64_t version,
+        std::vector<std::shared_ptr<job>>& exited
+    ) {
+        _owned.clear();
+        _jobs.clear();
+        _level_offsets.clear();
+
+        // The zeroth level consists of the root jobs
+        for (const auto& root : roots) {
+            if (root->_exited) {
+                exited.push_back(root);
+                continue;
+            }
+
+            root->_dependencies = 0;
+            _owned.push_back(root);
+        }
+
+        // Walk the tree breadth-first. The collection grows while we traverse it,
+        // and each time we pass the end of a level, the next one begins.
+        std::size_t level_end = 0;
+        for (std::size_t i = 0; i < _owned.size(); i++) {
+            if (i == level_end) {
+                _level_offsets.push_back(i);
+                level_end = _owned.size();
+            }
+
+            const auto parent = _owned[i].get();
+            parent->_successors.clear();
+            parent->_followers.clear();
+
+            std::lock_guard lock{ parent->job_mutex };
+            for (const auto& child : parent->children()) {
+                if (child->_exited) {
+                    exited.push_back(child);
+                    continue;
+                }
+
+                child->_dependencies = 1;
+                parent->_successors.push_back(child.get());
+                _owned.push_back(child);
+            }
+
+            // Released children are pushed in this order and popped in reverse,
+            // so the most important ones go last
+            std::ranges::stable_sort(parent->_successors, std::ranges::greater{}, &job::priority);
+        }
+        _level_offsets.push_back(_owned.size());
+
+        order_conflicts();
+
+        // Keep a raw copy for the hot path
+        _jobs.reserve(_owned.size());
+        for (const auto& job : _owned)
+            _jobs.push_back(job.get());
+
+        _version = version;
+    }
+}
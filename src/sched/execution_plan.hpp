@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace sched {
+    // Forward declarations
+    class job;
+
+    // A flattened, levelized copy of the job tree
+    // The runner compiles the tree into a plan once and reuses it every cycle until
+    // the tree is modified. Walking the plan needs no allocation, no reference
+    // counting and no locking.
+    class execution_plan {
+        // Keeps every job in the plan alive while workers only see raw pointers
+        std::vector<std::shared_ptr<job>> _owned;
+
+        // Every job in the plan in breadth-first order, so each level of the tree
+        // is a contiguous range
+        std::vector<job*> _jobs;
+
+        // Offsets into the job collection where each level begins, followed by
+        // the total amount of jobs
+        std::vector<std::size_t> _level_offsets;
+
+        // The topology version the plan was built from
+        std::uint64_t _version{ ~0ull };
+
+        // Make jobs whose declared accesses conflict wait on each other, and
+        // move them to separate levels
+        void order_conflicts();
+
+    public:
+        // Compile the tree under the given root jobs into the plan. Jobs that have
+        // exited are left out of the plan (along with their children) and are
+        // collected into the exited collection so the runner can erase them.
+        void build(const std::vector<std::shared_ptr<job>>& roots, std::uint64_t version,
+                   std::vector<std::shared_ptr<job>>& exited);
+
+        // Get the topology version the plan was built from
+        [[nodiscard]] auto version() const { return _version; }
+
+        // Get every job in the plan
+        [[nodiscard]] std::span<job* const> jobs() const { return _jobs; }
+
+        // Get the jobs with no parents
+        [[nodiscard]] std::span<job* const> roots() const { return level(0); }
+
+        // Get the amount of levels in the plan
+        [[nodiscard]] std::size_t level_count() const { return _level_offsets.size() - 1; }
+
+        // Get the jobs that make up a level of the tree (a sub-cycle)
+        [[nodiscard]] std::span<job* const> level(const std::size_t index) const {
+            if (index + 1 >= _level_offsets.size())
+                return {};
+
+            const auto begin = _level_offsets[index];
+            return std::span{ _jobs }.subspan(begin, _level_offsets[index + 1] - begin);
+        }
+
+        // Get the amount of jobs in the plan
+        [[nodiscard]] auto size() const { return _jobs.size(); }
+    };
+}
@@ -0,0 +1,52 @@
+#include "frame_arena.hpp"
+
+#include <algorithm>
+
+#include "worker.hpp"
+
+namespace sched {
+    void* frame_arena::do_allocate(const std::size_t bytes, const std::size_t alignment) {
+        while (true) {
+            // Try the rest of the current block, then any larger blocks left
+            // over from earlier frames
+            for (; _block < _blocks.size(); _block++, _offset = 0) {
+                const auto& current = _blocks[_block];
+                void* pointer = current.data.get() + _offset;
+                auto space = current.size - _offset;
+
+                if (std::align(alignment, bytes, pointer, space) != nullptr) {
+                    _offset = static_cast<std::byte*>(pointer) - current.data.get() + bytes;
+                    _used += bytes;
+                    return pointer;
+                }
+            }
+
+            // Out of blocks, so add one at least twice the size of the last
+            const auto size = std::max(_blocks.empty() ? _initial_size : _blocks.back().size * 2, bytes + alignment);
+            _blocks.push_back({ std::unique_ptr<std::byte[]>(new std::byte[size]), size });
+            _block = _blocks.size() - 1;
+            _offset = 0;
+        }
+    }
+
+    void frame_arena::reset() noexcept {
+        _block = 0;
+        _offset = 0;
+        _used = 0;
+    }
+
+    std::size_t frame_arena::capacity() const noexcept {
+        std::size_t capacity = 0;
+        for (const auto& current : _blocks)
+            capacity += current.size;
+        return capacity;
+    }
+
+    std::pmr::memory_resource& frame_memory() noexcept {
+        const auto current = worker::current();
+        if (current == nullptr)
+            return *std::pmr::get_default_resource();
+
+        return current->arena();
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+namespace sched {
+    // A linear allocator for scratch memory that only lives for one frame
+    // Allocating bumps a pointer and freeing does nothing. Every worker owns one,
+    // which the runner resets at the start of each cycle, so memory from it must
+    // not be held on to past the end of the frame. Blocks are kept across resets,
+    // so once the arena has grown to fit a frame it stops allocating.
+    class frame_arena final : public std::pmr::memory_resource {
+        struct block {
+            std::unique_ptr<std::byte[]> data;
+            std::size_t size;
+        };
+
+        // Every block the arena has allocated, in order of size
+        std::vector<block> _blocks;
+
+        // The block in use, and how far into it has been handed out
+        std::size_t _block{};
+        std::size_t _offset{};
+
+        // The amount of bytes handed out since the last reset
+        std::size_t _used{};
+
+        // The size of the first block
+        std::size_t _initial_size;
+
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+
+        void do_deallocate(void*, std::size_t, std::size_t) override {}
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+
+    public:
+        // The first block is allocated on first use
+        explicit frame_arena(std::size_t initial_size = 64 * 1024) : _initial_size(initial_size) {}
+
+        frame_arena(const frame_arena&) = delete;
+        frame_arena& operator=(const frame_arena&) = delete;
+
+        // Make all of the memory available again. Anything allocated from the
+        // arena before this is invalid afterwards.
+        void reset() noexcept;
+
+        // Get the amount of bytes handed out since the last reset
+        [[nodiscard]] std::size_t used() const noexcept { return _used; }
+
+        // Get the amount of bytes the arena holds across all of its blocks
+        [[nodiscard]] std::size_t capacity() const noexcept;
+    };
+
+    // Get the frame arena of the worker running on the calling thread, or the
+    // default memory resource if the thread is not a worker
+    std::pmr::memory_resource& frame_memory() noexcept;
+}
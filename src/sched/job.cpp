@@ -1,6 +1,57 @@
 #include "job.hpp"
 
+#include <functional>
+
+#include "worker.hpp"
+
 namespace sched {
+    void job::run(sched::worker& worker) {
+        worker.execute_job(*this);
+    }
+
+    namespace {
+        // Add a resource to a sorted access set
+        void insert_access(std::vector<resource_id>& accesses, const resource_id resource) {
+            const auto found = std::ranges::lower_bound(accesses, resource);
+            if (found == accesses.end() || *found != resource)
+                accesses.insert(found, resource);
+        }
+
+        // Determine if two sorted access sets share a resource
+        bool intersects(const std::vector<resource_id>& a, const std::vector<resource_id>& b) {
+            auto left = a.begin();
+            auto right = b.begin();
+            while (left != a.end() && right != b.end()) {
+                if (*left == *right)
+                    return true;
+                if (std::less<resource_id>{}(*left, *right))
+                    ++left;
+                else
+                    ++right;
+            }
+
+            return false;
+        }
+    }
+
+    void job::reads(const resource_id resource) {
+        insert_access(_reads, resource);
+
+        // The execution plan orders conflicting jobs
+        invalidate_topology();
+    }
+
+    void job::writes(const resource_id resource) {
+        insert_access(_writes, resource);
+        invalidate_topology();
+    }
+
+    bool job::conflicts_with(const job& other) const {
+        return intersects(_writes, other._writes)
+            || intersects(_writes, other._reads)
+            || intersects(_reads, other._writes);
+    }
+
     void job::schedule(const std::shared_ptr<job>& child) {
         if (child.get() == this)
             throw std::runtime_error("Cyclic job dependency detected");
@@ -12,6 +63,7 @@ namespace sched {
 
         std::lock_guard lock{ job_mutex };
         _children.push_back(child);
+        invalidate_topology();
     }
 
     void job::erase(const std::shared_ptr<job>& child) {
@@ -22,5 +74,6 @@ namespace sched {
 
         std::lock_guard lock{ job_mutex };
         std::erase(_children, child);
+        invalidate_topology();
     }
 }
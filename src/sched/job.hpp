@@ -1,16 +1,52 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <memory>
 #include <atomic>
 #include <mutex>
+#include <type_traits>
 #include <vector>
 
+#include "task.hpp"
+
 namespace sched {
     // Forward declarations
     class worker;
 
+    // Determines which jobs run first, and which may be put off when a frame is
+    // running late
+    enum class job_priority {
+        // Needed to finish the frame on time, such as rendering. Runs first.
+        critical,
+
+        // The default
+        normal,
+
+        // Work that can wait a frame, such as AI planning or statistics. Deferred
+        // to the next frame if running it would miss the frame deadline.
+        best_effort
+    };
+
+    // Identifies something jobs read or write, such as a component type
+    using resource_id = const void*;
+
+    namespace detail {
+        // Every type gets its own tag, whose address identifies the type
+        template <class T>
+        struct resource_tag {
+            static constexpr char tag{};
+        };
+    }
+
+    // Get the resource that stands for a type. Qualifiers are ignored.
+    template <class T>
+    constexpr resource_id resource_of() noexcept {
+        return &detail::resource_tag<std::remove_cvref_t<T>>::tag;
+    }
+
     // Represents a task that can be executed by a worker
-    class job : public std::enable_shared_from_this<job> {
+    class job : public task, public std::enable_shared_from_this<job> {
         // Pointer to the worker that this job is assigned to
         std::atomic<sched::worker*> _worker;
 
@@ -22,13 +58,94 @@ namespace sched {
         // A collection of nth-sub-cycle jobs that are scheduled to be executed
         std::vector<std::shared_ptr<job>> _children;
 
+        // The children recorded by the execution plan. Only touched by the arbiter
+        // while workers are suspended, and read by the worker that completes this job.
+        std::vector<job*> _successors;
+
+        // Jobs that have to wait for this one because their accesses conflict,
+        // as recorded by the execution plan. Unlike children, they still run if
+        // this job is skipped.
+        std::vector<job*> _followers;
+
+        // The resources the job reads and writes, kept sorted. Only written
+        // before the job is scheduled.
+        std::vector<resource_id> _reads;
+        std::vector<resource_id> _writes;
+
+        // The amount of jobs this job waits on, parents and conflicting jobs
+        // alike, as recorded by the execution plan
+        std::uint32_t _dependencies{};
+
+        // The amount of parents that have not completed yet in the current cycle.
+        // The job becomes runnable once this reaches zero.
+        std::atomic<std::uint32_t> _pending{};
+
+        // Exponentially smoothed execution time of the job in seconds
+        std::atomic<double> _cost{};
+
+        // The cost the arbiter uses to place the job in the current cycle
+        // Only touched by the arbiter
+        double _placement_cost{};
+
+        // The priority class of the job
+        std::atomic<job_priority> _priority{ job_priority::normal };
+
+        // The job runs once every this many cycles of its lane
+        std::atomic<std::uint32_t> _divisor{ 1 };
+
+        // The cycle, modulo the divisor, that the job runs in, and the divisor
+        // it was picked for. Only touched by the arbiter.
+        std::uint32_t _phase{};
+        std::uint32_t _phase_divisor{ 1 };
+
+        // The ID of the worker the job is pinned to, or one of the special
+        // pinning targets
+        std::atomic<std::uint32_t> _pinned_to{ ~0u };
+
+        // The worker the pin resolved to in the current cycle, or nullptr if the
+        // job isn't pinned. Only written by the arbiter while workers are suspended.
+        sched::worker* _pinned_worker{};
+
+        // The next job in the mailbox of the worker the job is pinned to. Lets
+        // pinned jobs be handed over without allocating.
+        job* _next_delivered{};
+
+        // Set when the job is skipped in the current cycle. A job is skipped if
+        // it is not due, it is deferred or any of its parents was skipped.
+        std::atomic<bool> _skipped{ false };
+
+        // The amount of cycles in a row that the job has been deferred
+        // Only touched by the worker executing the job
+        std::uint32_t _deferrals{};
+
         // Exit code (reserved for future use)
         int _exit_code{};
 
         // Determines if the job is scheduled to be re-executed
         bool _exited{ false };
 
+        // Fold a new execution time sample into the smoothed cost
+        void record_cost(const double sample, const double smoothing) {
+            // Only the worker executing the job writes this, so a plain
+            // load and store is enough
+            const auto previous = _cost.load(std::memory_order_relaxed);
+            const auto next = previous == 0.0 ? sample : previous + smoothing * (sample - previous);
+            _cost.store(next, std::memory_order_relaxed);
+        }
+
+        // Incremented whenever any job tree is modified. Runners compare this
+        // against the version of their cached execution plan to know when the
+        // plan has to be rebuilt.
+        static inline std::atomic<std::uint64_t> _topology_version{ 0 };
+
     public:
+        // Pinning target for a job that may run on any worker
+        static constexpr std::uint32_t any_worker = ~0u;
+
+        // Pinning target for the main worker, the oldest worker in the pool. It is
+        // the last worker to be removed when the pool shrinks.
+        static constexpr std::uint32_t main_worker = ~0u - 1;
+
         // Mutex for the children collection
         std::recursive_mutex job_mutex;
 
@@ -40,11 +157,15 @@ namespace sched {
         // Run the task
         virtual void execute() = 0;
 
+        // Execute the job on a worker, keeping track of its cost and releasing
+        // its children once it is done
+        void run(sched::worker& worker) final;
+
         // Destroy the job and any resources it may have allocated
         virtual ~job() = default;
 
         // Get the worker that this job is assigned to
-        [[nodiscard]] auto worker() const { return _worker.load(); }
+        [[nodiscard]] auto worker() const { return _worker.load(std::memory_order_relaxed); }
 
         // Get a collection of child jobs
         [[nodiscard]] auto& children() const { return _children; }
@@ -52,12 +173,95 @@ namespace sched {
         // Get the parent job
         [[nodiscard]] auto parent() const { return _parent; }
 
+        // Get the smoothed execution time of the job in seconds
+        // This is zero until the job has been executed once
+        [[nodiscard]] double cost() const { return _cost.load(std::memory_order_relaxed); }
+
+        // Get the priority class of the job
+        [[nodiscard]] job_priority priority() const { return _priority.load(std::memory_order_relaxed); }
+
+        // Change the priority class of the job. Takes effect on the next cycle.
+        void set_priority(const job_priority priority) {
+            _priority.store(priority, std::memory_order_relaxed);
+
+            // The execution plan orders jobs by priority
+            invalidate_topology();
+        }
+
+        // Get the amount of cycles between two runs of the job
+        [[nodiscard]] std::uint32_t divisor() const { return _divisor.load(std::memory_order_relaxed); }
+
+        // Run the job once every this many cycles of its lane instead of every
+        // cycle. The runner picks which of those cycles the job runs in, so that
+        // jobs with the same divisor are spread out. Takes effect on the next cycle.
+        void set_divisor(const std::uint32_t divisor) {
+            _divisor.store(std::max<std::uint32_t>(divisor, 1), std::memory_order_relaxed);
+
+            // The runner picks phases when it rebuilds its plan
+            invalidate_topology();
+        }
+
+        // Get the ID of the worker the job is pinned to, or one of the special
+        // pinning targets
+        [[nodiscard]] std::uint32_t pinned_to() const { return _pinned_to.load(std::memory_order_relaxed); }
+
+        // Always run the job on the worker with the given ID, or on the main
+        // worker if there is no such worker. Pinned jobs are never stolen, which
+        // keeps thread-bound state such as a window on one thread. Takes effect
+        // on the next cycle.
+        void pin(const std::uint32_t worker_id) { _pinned_to.store(worker_id, std::memory_order_relaxed); }
+
+        // Always run the job on the main worker
+        void pin_to_main() { pin(main_worker); }
+
+        // Let the job run on any worker again
+        void unpin() { pin(any_worker); }
+
+        // Declare that the job reads a resource. Jobs that declare their accesses
+        // may run at the same time unless one writes what the other uses, in
+        // which case the one that comes first in the plan runs first. The plan
+        // is breadth-first, with the roots in the order they were scheduled.
+        // This is not thread-safe, so accesses are declared before the job is
+        // scheduled.
+        void reads(resource_id resource);
+
+        // Declare that the job writes a resource
+        void writes(resource_id resource);
+
+        // Declare that the job reads the given types
+        template <class... Ts>
+        void reads() { (reads(resource_of<Ts>()), ...); }
+
+        // Declare that the job writes the given types
+        template <class... Ts>
+        void writes() { (writes(resource_of<Ts>()), ...); }
+
+        // Determine if two jobs can't run at the same time because one writes a
+        // resource that the other reads or writes
+        [[nodiscard]] bool conflicts_with(const job& other) const;
+
+        // Get the cycle, modulo the divisor, that the job runs in
+        [[nodiscard]] std::uint32_t phase() const { return _phase; }
+
         // Stop scheduling the job
         void exit(const int exit_code = 0) {
             // These are OK to be set non-atomically since they are only
             // accessed by the arbiter thread during a non-execution phase
             _exit_code = exit_code;
             _exited = true;
+
+            // The runner erases exited jobs when it rebuilds its plan
+            invalidate_topology();
+        }
+
+        // Get the current version of the job trees
+        [[nodiscard]] static std::uint64_t topology_version() {
+            return _topology_version.load(std::memory_order_acquire);
+        }
+
+        // Mark every cached execution plan as out of date
+        static void invalidate_topology() {
+            _topology_version.fetch_add(1, std::memory_order_acq_rel);
         }
 
         // Add a child job
@@ -69,5 +273,6 @@ namespace sched {
         // Friend classes
         friend class runner;
         friend class worker;
+        friend class execution_plan;
     };
 }
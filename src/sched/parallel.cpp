@@ -0,0 +1,79 @@
+#include "parallel.hpp"
+
+#include <memory_resource>
+
+#include "runner.hpp"
+#include "worker.hpp"
+
+namespace sched::detail {
+    void range_task::split_and_execute(sched::worker& worker) noexcept {
+        // Skip the work if another piece has already failed
+        if (_state->failed.load(std::memory_order_relaxed))
+            return;
+
+        // Halve the range until it is small enough. The upper halves are pushed
+        // onto our deque, where the largest ones sit on top for thieves to take.
+        auto piece = _range;
+        while (piece.size() > _state->grain) {
+            const auto middle = piece.begin + piece.size() / 2;
+
+            const auto slot = _state->next_slot.fetch_add(1, std::memory_order_relaxed);
+            auto& half = _state->tasks[slot - 1];
+            half = range_task{ _state, { middle, piece.end }, slot };
+
+            _state->pending.fetch_add(1, std::memory_order_relaxed);
+            worker.spawn(&half);
+
+            piece.end = middle;
+        }
+
+        try {
+            _state->execute(piece, _slot);
+        }
+        catch (...) {
+            // Keep the first exception for the caller, which has to wait for the
+            // rest of the pieces before it can rethrow it
+            if (!_state->failed.exchange(true, std::memory_order_acq_rel))
+                _state->error = std::current_exception();
+        }
+    }
+
+    void range_task::run(sched::worker& worker) {
+        split_and_execute(worker);
+
+        // The state lives on the caller's stack, and is gone as soon as the last
+        // piece reports in. Nothing may touch it after this.
+        worker.finish_spawned(_state->pending);
+    }
+
+    std::uint32_t max_pieces(const std::size_t size, const std::size_t grain) noexcept {
+        // Only pieces larger than the grain are split, so every piece holds
+        // at least half of the grain
+        const auto smallest = std::max<std::size_t>((grain + 1) / 2, 1);
+        return static_cast<std::uint32_t>(std::max<std::size_t>(size / smallest, 1));
+    }
+
+    void run_ranges(range_state& state, const range& whole) {
+        // Run the range on the calling thread if there is nowhere to fan out to
+        const auto current = worker::current();
+        if (current == nullptr || !current->runner()->work_stealing || whole.size() <= state.grain) {
+            state.execute(whole, 0);
+            return;
+        }
+
+        // The pieces only live for this call, so they come out of the frame arena
+        std::pmr::vector<range_task> tasks(max_pieces(whole.size(), state.grain) - 1, &frame_memory());
+        state.tasks = tasks;
+
+        // The calling worker takes the first piece itself, then helps with the
+        // pieces that were not stolen until every piece has finished
+        const auto depth = current->depth();
+        range_task first{ &state, whole, 0 };
+        first.split_and_execute(*current);
+
+        current->help_until(state.pending, depth);
+
+        if (state.error)
+            std::rethrow_exception(state.error);
+    }
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory_resource>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "frame_arena.hpp"
+#include "task.hpp"
+
+namespace sched {
+    // A half-open range of indices
+    struct range {
+        std::size_t begin{};
+        std::size_t end{};
+
+        // Get the amount of indices in the range
+        [[nodiscard]] std::size_t size() const noexcept { return end > begin ? end - begin : 0; }
+
+        // Determine if the range has no indices
+        [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+    };
+
+    namespace detail {
+        // Forward declarations
+        class range_task;
+
+        // The state shared by every piece of a single parallel call
+        class range_state {
+        public:
+            // Pieces larger than this are split in half
+            std::size_t grain{ 1 };
+
+            // The amount of pieces that have not finished yet
+            std::atomic<std::uint32_t> pending{ 0 };
+
+            // The next unused task slot. Slot zero is the calling worker's piece.
+            std::atomic<std::uint32_t> next_slot{ 1 };
+
+            // Storage for the pieces that are handed to other workers
+            std::span<range_task> tasks{};
+
+            // The first exception thrown by a piece, rethrown by the caller
+            std::exception_ptr error{};
+            std::atomic<bool> failed{ false };
+
+            // Execute one piece of the range
+            virtual void execute(const range& piece, std::uint32_t slot) = 0;
+
+        protected:
+            ~range_state() = default;
+        };
+
+        // A piece of a range that can be stolen by another worker
+        class range_task final : public task {
+            range_state* _state{};
+            range _range{};
+            std::uint32_t _slot{};
+
+        public:
+            range_task() = default;
+            range_task(range_state* state, const range& range, const std::uint32_t slot)
+                : _state(state), _range(range), _slot(slot) {}
+
+            // Split off the upper half of the range until it is small enough,
+            // spawning each half on the worker, then execute what is left
+            void split_and_execute(sched::worker& worker) noexcept;
+
+            // Execute a spawned piece and report its completion
+            void run(sched::worker& worker) override;
+        };
+
+        // Get the largest amount of pieces a range can be split into
+        std::uint32_t max_pieces(std::size_t size, std::size_t grain) noexcept;
+
+        // Execute every piece of the range, fanning out over the runner's workers
+        // when called from a job. Falls back to a single piece otherwise.
+        void run_ranges(range_state& state, const range& whole);
+
+        // Adapts a callable to the range state
+        template <class Fn>
+        class for_state final : public range_state {
+            Fn& _fn;
+
+        public:
+            explicit for_state(Fn& fn) : _fn(fn) {}
+
+            void execute(const range& piece, std::uint32_t) override { _fn(piece); }
+        };
+
+        // Adapts a callable to the range state, keeping one partial result per piece
+        template <class T, class Fn>
+        class reduce_state final : public range_state {
+            Fn& _fn;
+            const T& _identity;
+
+        public:
+            // The partial result of each piece along with where the piece begins.
+            // These only live for the call, so they come out of the frame arena.
+            std::pmr::vector<std::pair<std::size_t, T>> partials;
+
+            reduce_state(Fn& fn, const T& identity, const std::uint32_t pieces)
+                : _fn(fn), _identity(identity), partials(pieces, { 0, identity }, &frame_memory()) {}
+
+            void execute(const range& piece, const std::uint32_t slot) override {
+                partials[slot] = { piece.begin, _fn(piece, _identity) };
+            }
+        };
+    }
+
+    // Call fn(range) for pieces of the range in parallel, and return once every
+    // piece is done. When called from inside a job, the pieces are spread over the
+    // runner's workers within the current sub-cycle, with the calling worker
+    // helping out until the range is done. Pieces are split in half until they
+    // hold no more than grain indices. Called from elsewhere, this runs fn once
+    // over the whole range.
+    template <class Fn>
+    void parallel_for(const range& range, const std::size_t grain, Fn&& fn) {
+        if (range.empty())
+            return;
+
+        detail::for_state<Fn> state{ fn };
+        state.grain = std::max<std::size_t>(grain, 1);
+        detail::run_ranges(state, range);
+    }
+
+    // Reduce the range in parallel. Each piece is reduced with fn(range, identity)
+    // and the partial results are merged with combine(T, T), in order of the
+    // range, so combine only has to be associative. The pieces are spread over
+    // the runner's workers like parallel_for.
+    template <class T, class Fn, class Combine>
+    T parallel_reduce(const range& range, const std::size_t grain, T identity, Fn&& fn, Combine&& combine) {
+        if (range.empty())
+            return identity;
+
+        const auto pieces = detail::max_pieces(range.size(), std::max<std::size_t>(grain, 1));
+        detail::reduce_state<T, Fn> state{ fn, identity, pieces };
+        state.grain = std::max<std::size_t>(grain, 1);
+        detail::run_ranges(state, range);
+
+        // Only the used slots hold a result. Which slot a piece lands in depends
+        // on timing, but the split points do not, so sorting makes this stable.
+        const auto used = state.partials.begin() + state.next_slot.load(std::memory_order_relaxed);
+        std::sort(state.partials.begin(), used, [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        auto result = std::move(identity);
+        for (auto partial = state.partials.begin(); partial != used; ++partial)
+            result = combine(std::move(result), std::move(partial->second));
+        return result;
+    }
+}
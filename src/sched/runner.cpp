@@ -2,10 +2,14 @@
 
 #include <algorithm>
 #include <bitset>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
 #include <random>
 #include <ranges>
 
-#include "SDL_video.h"
 #include "worker.hpp"
 #include "job.hpp"
 
@@ -13,7 +17,12 @@ namespace sched {
     // We can assume that our core count is static due to the nature of the
     // operating system. This is highly unlikely to change because it would
     // break the OS to change the amount of logical cores on the system
-    std::uint32_t runner::_core_count = 2;//std::thread::hardware_concurrency();
+    std::uint32_t runner::_core_count = static_cast<std::uint32_t>(topology().size());
+
+    const std::vector<platform::cpu_info>& runner::topology() {
+        static const auto cpus = platform::cpu_topology();
+        return cpus;
+    }
 
     void runner::push_worker() {
         // Get the next worker ID
@@ -30,168 +39,726 @@ namespace sched {
         // This will transfer the thread ownership to the pool
         std::lock_guard lock{ _worker_pool_mutex };
         _worker_pool.emplace(raw_worker->id(), std::move(new_worker));
+        _worker_pool_version++;
 
         // We can now start the worker thread
         // This is done while locked because we don't want to have a
         // non-running worker in the pool
-        raw_worker->detach();
+        raw_worker->start();
     }
 
-    bool runner::pop_worker() {
-        // Get the worker ID
-        const auto worker_id = --_worker_id_counter;
-
+    std::unique_ptr<worker> runner::take_worker() {
         // Acquire a lock on the worker pool
         std::lock_guard lock{ _worker_pool_mutex };
 
         // If there are no workers in the pool, we can't pop a worker
         // because there are no workers to pop
         if (_worker_pool.empty())
-            return false;
+            return nullptr;
+
+        // IDs are not contiguous once workers come and go, so find the newest
+        const auto newest = std::ranges::max_element(
+            _worker_pool, {}, [](const auto& pair) { return pair.first; });
 
         // Transfer ownership and remove
-        std::unique_ptr<worker> worker = std::move(_worker_pool[worker_id]);
-        _worker_pool.erase(worker_id);
+        auto worker = std::move(newest->second);
+        _worker_pool.erase(newest);
+        _worker_pool_version++;
+
+        // Give the CPUs back for the next worker
+        release_affinity_mask(worker->affinity());
+        return worker;
+    }
+
+    bool runner::pop_worker() {
+        auto worker = take_worker();
+        if (worker == nullptr)
+            return false;
 
-        // RAII will destroy the worker
+        // The arbiter may be running a cycle on this worker right now, so let it
+        // destroy the worker once the cycle is over
+        if (_arbiter_running) {
+            std::lock_guard lock{ _worker_pool_mutex };
+            _retired_workers.push_back(std::move(worker));
+        }
+
+        // Otherwise RAII will destroy the worker
         return true;
     }
 
-    void runner::assign_job(
-        const std::shared_ptr<job>& job,
-        std::uint32_t& next_worker_id,
-        std::vector<std::shared_ptr<sched::job>>& run_next
-    ) noexcept {
-        // We're looking for the least busy worker, so we need to assign them
-        // from low id -> high id and wrap around. This ensures an even job
-        // distribution between workers
+    void runner::refresh_workers() {
+        // Destroy retired workers outside of the lock since it joins the threads
+        std::vector<std::unique_ptr<worker>> retired{};
+
+        {
+            std::lock_guard lock{ _worker_pool_mutex };
+            std::swap(retired, _retired_workers);
+
+            // Only rebuild the snapshot if the pool changed
+            if (_worker_pool_version == _workers_version)
+                return;
+            _workers_version = _worker_pool_version;
+
+            _workers.clear();
+            for (const auto& worker : _worker_pool | std::views::values)
+                _workers.push_back(worker.get());
+        }
+
+        // Keep a stable order so round-robin assignment is predictable
+        std::ranges::sort(_workers, {}, &worker::id);
+    }
+
+    std::uint32_t runner::worker_limit() {
+        const auto limit = max_workers.load();
+
+        // Without pinning we allow one worker per logical core, unless told otherwise
+        std::lock_guard lock{ _affinity_mutex };
+        if (_affinity_slots.empty())
+            return limit != 0 ? limit : _core_count;
+
+        // Otherwise, every slot not taken by something other than a worker. Each
+        // worker needs a slot of its own, so the limit can't go past that.
+        const auto used = std::ranges::count(_affinity_slots_used, true);
+        const auto slots = static_cast<std::uint32_t>(_affinity_slots.size() - used + _workers.size());
+        return limit != 0 ? std::min(limit, slots) : slots;
+    }
+
+    void runner::autoscale(const double exec_delta) {
+        const auto worker_count = static_cast<std::uint32_t>(_workers.size());
+        if (worker_count == 0)
+            return;
+
+        // Collect how long each worker spent executing jobs this cycle
+        auto busy_time = 0.0;
+        for (const auto worker : _workers) {
+            busy_time += worker->_busy_time;
+            worker->_busy_time = 0.0;
+        }
+
+        if (!elastic)
+            return;
+
+        // Compare against the frame budget. When uncapped, the cycle itself is
+        // the budget, which measures how well the cycle was parallelized.
+        const auto budget = frame_delay > 0 ? frame_delay.load() : exec_delta;
+        if (budget <= 0)
+            return;
+        const auto load = busy_time / (worker_count * budget);
+
+        // Keep a sliding window of the load
+        const auto window = std::max(1u, scale_window.load());
+        if (_load_window.size() != window) {
+            _load_window.assign(window, 0.0);
+            _load_sum = 0.0;
+            _load_samples = 0;
+        }
+
+        const auto index = _load_samples++ % window;
+        _load_sum += load - _load_window[index];
+        _load_window[index] = load;
+
+        // Wait for the window to fill up before making a decision
+        if (_load_samples < window)
+            return;
+        const auto average = _load_sum / window;
+
+        // Add a worker when the pool is saturated, and the frame is actually
+        // running up against the budget
+        const auto cpu_bound = frame_delay <= 0 || exec_delta >= frame_delay * grow_utilization;
+        if (average >= grow_utilization && cpu_bound && worker_count < worker_limit()) {
+            // Something else may have taken the last free slot in the meantime,
+            // in which case the pool just stays at its size
+            try {
+                push_worker();
+            }
+            catch (const std::runtime_error&) {
+                return;
+            }
+        }
+        // Retire a worker when even the smaller pool would stay below the shrink
+        // threshold. Projecting the load keeps the pool from flapping.
+        else if (worker_count > std::max(1u, min_workers.load())
+                 && average * worker_count / (worker_count - 1) < shrink_utilization) {
+            // The snapshot still points at the worker for the rest of the cycle,
+            // so it is retired rather than destroyed here
+            pop_worker();
+        }
+        else {
+            return;
+        }
+
+        // Start a fresh window for the new pool size
+        _load_samples = 0;
+        _load_sum = 0.0;
+        std::ranges::fill(_load_window, 0.0);
+    }
+
+
+    void runner::place_jobs(const std::span<job* const> jobs, std::uint32_t& next_worker_id) {
+        // There is nobody to run the jobs
+        if (_workers.empty())
+            return;
+
+        // Pinned jobs are not up for placement
+        _placement_order.clear();
+        _pinned_order.clear();
+        for (const auto job : jobs)
+            (job->_pinned_worker != nullptr ? _pinned_order : _placement_order).push_back(job);
+        _placement_targets.clear();
+
+        // Mailboxes are first in first out, so they are filled in priority order
+        std::ranges::stable_sort(_pinned_order, {}, &job::priority);
+        for (const auto job : _pinned_order)
+            job->_pinned_worker->deliver(job);
+
+        // The rest of the jobs are distributed in priority order, so the critical
+        // jobs are spread over the pool before anything else is placed
+
+        if (placement == placement_policy::round_robin || _workers.size() < 2) {
+            std::ranges::stable_sort(_placement_order, {}, &job::priority);
+
+            for (std::size_t i = 0; i < _placement_order.size(); i++) {
+                // Wrap around to the first worker
+                if (next_worker_id >= _workers.size())
+                    next_worker_id = 0;
+                _placement_targets.push_back(next_worker_id++);
+            }
+        }
+        else {
+            // Longest-processing-time-first: sort by cost, then hand each job to
+            // the worker with the least work placed on it so far
+            std::ranges::sort(_placement_order, [](const job* a, const job* b) {
+                if (a->priority() != b->priority())
+                    return a->priority() < b->priority();
+                return a->_placement_cost > b->_placement_cost;
+            });
+
+            // Min-heap of (placed cost, worker index), starting out with the
+            // cost of the jobs pinned to each worker
+            _worker_loads.clear();
+            for (auto i = 0u; i < _workers.size(); i++)
+                _worker_loads.emplace_back(0.0, i);
+
+            for (const auto job : _pinned_order) {
+                const auto worker_index = std::ranges::find(_workers, job->_pinned_worker) - _workers.begin();
+                _worker_loads[worker_index].first += job->_placement_cost;
+            }
+            std::ranges::make_heap(_worker_loads, std::ranges::greater{});
+
+            for (const auto job : _placement_order) {
+                std::ranges::pop_heap(_worker_loads, std::ranges::greater{});
+                auto& [load, worker_index] = _worker_loads.back();
+
+                _placement_targets.push_back(worker_index);
+                load += job->_placement_cost;
+
+                std::ranges::push_heap(_worker_loads, std::ranges::greater{});
+            }
+        }
+
+        // Workers pop their own jobs in reverse, so the jobs are queued in
+        // reverse to have each worker run them in placement order. The workers
+        // are suspended, so this is safe to do without waking them up.
+        for (auto i = _placement_order.size(); i-- > 0;)
+            _workers[_placement_targets[i]]->assign(_placement_order[i]);
+    }
+
+    worker* runner::pinned_worker(const job& job) const noexcept {
+        const auto target = job.pinned_to();
+        if (target == job::any_worker || _workers.empty())
+            return nullptr;
+
+        // The snapshot is sorted by ID, so the oldest worker is the main worker
+        if (target != job::main_worker) {
+            if (const auto found = std::ranges::find(_workers, target, &worker::id); found != _workers.end())
+                return *found;
+        }
+
+        return _workers.front();
+    }
+
+    void runner::route_pinned(const std::span<job* const> jobs) noexcept {
+        for (const auto job : jobs) {
+            job->_pinned_worker = pinned_worker(*job);
+            if (job->_pinned_worker != nullptr)
+                job->_pinned_worker->_pinned_expected.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool runner::should_defer(const job& job) const noexcept {
+        // Without a frame delay, there is no deadline to miss
+        if (_frame_deadline == time_point::max())
+            return false;
+
+        // Don't let the job starve
+        if (job._deferrals >= max_deferrals.load(std::memory_order_relaxed))
+            return false;
+
+        const auto margin = duration(defer_margin.load(std::memory_order_relaxed));
+        const auto expected_end = clock::now() + std::chrono::duration_cast<clock::duration>(duration(job.cost()) + margin);
+        return expected_end > _frame_deadline;
+    }
+
+    void runner::signal_work() noexcept {
+        // Sequentially consistent so either the idle worker sees the new signal
+        // before parking, or we see the idle worker and wake it
+        _work_signal.fetch_add(1, std::memory_order_seq_cst);
+        if (_idle_workers.load(std::memory_order_seq_cst) != 0)
+            _work_signal.notify_all();
+    }
+
+    void runner::wait_for_work(spinner& spinner, const std::uint32_t seen_signal) noexcept {
+        const auto changed = [&] { return _work_signal.load(std::memory_order_acquire) != seen_signal; };
+        if (spinner.spin(changed, spin_count))
+            return;
+
+        _idle_workers.fetch_add(1, std::memory_order_seq_cst);
+        if (_work_signal.load(std::memory_order_seq_cst) == seen_signal)
+            _work_signal.wait(seen_signal, std::memory_order_acquire);
+        _idle_workers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void runner::wake_workers() noexcept {
+        // Every worker is woken, even ones without jobs, so they can steal
+        _cycle_barrier.reset(static_cast<std::uint32_t>(_workers.size()));
+        for (const auto worker : _workers)
+            worker->wake();
+    }
+
+    void runner::wait_for_workers() noexcept {
+        const auto wait_start = clock::now();
+        _cycle_barrier.wait(_arbiter_spinner, spin_count);
+
+        if (tracing.load(std::memory_order_relaxed))
+            trace("barrier", "barrier", wait_start, clock::now(), "frame", _frame);
+    }
+
+    void runner::rebuild_plan() {
+        // Read the version before copying so a modification made while we are
+        // building is picked up by the next cycle
+        const auto version = job::topology_version();
+
+        // Acquire a lock on the root job collection and copy the jobs
+        // to a temporary buffer that we can safely use
+        std::vector<std::shared_ptr<job>> roots{};
+        std::vector<std::shared_ptr<job>> simulation_roots{};
+        {
+            std::lock_guard lock{ _root_jobs_mutex };
+            roots = _root_jobs;
+            simulation_roots = _simulation_jobs;
+        }
+
+        std::vector<std::shared_ptr<job>> exited{};
+        _plan.build(roots, version, exited);
+        _simulation_plan.build(simulation_roots, version, exited);
+        assign_phases(_plan);
+        assign_phases(_simulation_plan);
 
         // If the job has exited, erase it from the scheduler
-        if (job->_exited) {
+        for (const auto& job : exited)
             erase(job);
+    }
+
+    void runner::assign_phases(const execution_plan& plan) {
+        // The cost placed on each phase, for each divisor
+        std::unordered_map<std::uint32_t, std::vector<double>> phase_costs{};
+        std::vector<job*> unassigned{};
+
+        // Jobs keep their phase as long as their divisor does not change, so
+        // adding a job doesn't shuffle the others around. Zero cost jobs still
+        // count a little, so unmeasured jobs are spread out as well.
+        for (const auto job : plan.jobs()) {
+            const auto divisor = job->divisor();
+            if (divisor == 1)
+                continue;
+
+            auto& costs = phase_costs[divisor];
+            costs.resize(divisor);
+            if (job->_phase_divisor == divisor)
+                costs[job->_phase] += job->cost() + 1e-6;
+            else
+                unassigned.push_back(job);
+        }
+
+        // Place the most expensive jobs first, each on its cheapest phase
+        std::ranges::sort(unassigned, std::ranges::greater{}, &job::cost);
+        for (const auto job : unassigned) {
+            const auto divisor = job->divisor();
+            auto& costs = phase_costs[divisor];
+            const auto phase = std::ranges::min_element(costs) - costs.begin();
+
+            job->_phase = static_cast<std::uint32_t>(phase);
+            job->_phase_divisor = divisor;
+            costs[phase] += job->cost() + 1e-6;
+        }
+    }
+
+    void runner::run_plan(execution_plan& plan, const std::uint64_t lane_cycle, std::uint32_t& next_worker_id) {
+        // Skip the jobs that are not due, along with those that were skipped or
+        // deferred in the last cycle. Children of skipped jobs are skipped by
+        // the worker.
+        for (const auto job : plan.jobs()) {
+            const auto due = job->_phase_divisor == 1 || lane_cycle % job->_phase_divisor == job->_phase;
+            job->_skipped.store(!due, std::memory_order_relaxed);
+        }
+
+        if (_cycle_mode == execution_mode::graph)
+            run_graph(plan, next_worker_id);
+        else
+            run_sub_cycles(plan, next_worker_id);
+    }
+
+    void runner::run_simulation(const double elapsed, std::uint32_t& next_worker_id) {
+        if (_simulation_plan.size() == 0)
+            return;
+
+        // Without a timestep, the simulation keeps pace with the frames
+        const auto step = tick_delay.load();
+        if (step <= 0) {
+            run_plan(_simulation_plan, _tick, next_worker_id);
+            _tick++;
+            _alpha = 1.0;
             return;
         }
 
-        // If the worker ID is higher than the worker ID counter, we need to
-        // reset the worker ID counter to 0 so we can start from the beginning
-        if (next_worker_id == _worker_id_counter)
-            next_worker_id = 0;
+        // Take as many steps as fit in the time that passed, up to the limit
+        _tick_accumulator += elapsed;
+        const auto limit = max_ticks.load();
+        std::uint32_t steps = 0;
+        while (_tick_accumulator >= step && steps < limit) {
+            const auto tick_start = clock::now();
+            run_plan(_simulation_plan, _tick, next_worker_id);
 
-        // Acquire a lock on the worker pool and extract the worker
-        std::lock_guard lock{ _worker_pool_mutex };
+            if (tracing.load(std::memory_order_relaxed))
+                trace("tick", "cycle", tick_start, clock::now(), "tick", _tick);
 
-        // Find the worker
-        const auto& worker_pair = _worker_pool.find(next_worker_id++);
-        if (worker_pair == _worker_pool.end()) {
-            // Check if there are any more workers
-            if (_worker_pool.empty() || next_worker_id == 1)
-                return;
+            _tick_accumulator -= step;
+            _tick++;
+            steps++;
+        }
+
+        // Drop what could not be caught up on, otherwise every following frame
+        // would be spent catching up as well
+        if (_tick_accumulator >= step)
+            _tick_accumulator = std::fmod(_tick_accumulator, step);
+
+        _alpha = _tick_accumulator / step;
+    }
+
+    void runner::run_sub_cycles(execution_plan& plan, std::uint32_t& next_worker_id) {
+        // Each level of the plan is a sub-cycle. The zeroth sub-cycle runs the
+        // root jobs, and the nth sub-cycle runs the children of the jobs in the
+        // (n-1)th sub-cycle.
+        for (std::size_t i = 0; i < plan.level_count(); i++) {
+            // Distribute the jobs first, then resume the workers all at once
+            const auto sub_cycle_start = clock::now();
+            const auto level = plan.level(i);
+            for (const auto job : level)
+                job->_placement_cost = job->cost();
+            _outstanding = level.size();
+            route_pinned(level);
+            place_jobs(level, next_worker_id);
+            wake_workers();
+
+            // Wait for all workers to suspend (sub-cycle finished)
+            wait_for_workers();
+
+            if (tracing.load(std::memory_order_relaxed))
+                trace("sub-cycle", "cycle", sub_cycle_start, clock::now(), "level", i);
+        }
+    }
 
-            // Worker was likely popped; decrement and try again
-            next_worker_id -= 2; // -2 because we incremented earlier
-            assign_job(job, next_worker_id, run_next);
+    void runner::run_graph(execution_plan& plan, std::uint32_t& next_worker_id) {
+        const auto jobs = plan.jobs();
+        if (jobs.empty())
             return;
+
+        // Reset the dependency counters from the plan
+        for (const auto job : jobs) {
+            job->_pending.store(job->_dependencies, std::memory_order_relaxed);
+            job->_placement_cost = job->cost();
+        }
+        _outstanding = jobs.size();
+        route_pinned(jobs);
+
+        // Released children stay on the worker that ran their parent unless
+        // they are stolen, so roots are weighed by the cost of their subtree.
+        // Pinned children run on their own worker instead. The plan is
+        // breadth-first, so walking it backwards visits children before their
+        // parents.
+        for (auto i = jobs.size(); i-- > 0;) {
+            const auto job = jobs[i];
+            for (const auto successor : job->_successors) {
+                if (successor->_pinned_worker == nullptr)
+                    job->_placement_cost += successor->_placement_cost;
+            }
         }
-        const auto& worker = worker_pair->second;
 
-        // Assign the job to the worker
-        worker->assign(job);
-        worker->wake();
+        // Place the roots and let the workers release the rest of the graph
+        place_jobs(plan.roots(), next_worker_id);
+
+        wake_workers();
+        wait_for_workers();
+    }
+
+    void runner::complete_job(worker& worker, job* job) noexcept {
+        // Release every child and follower that has nothing left to wait on.
+        // They are pushed onto the completing worker's deque, where idle workers
+        // can steal them. In sub-cycle mode, they run in a later sub-cycle instead.
+        auto released = false;
+        if (_cycle_mode == execution_mode::graph) {
+            const auto release = [&](sched::job* successor) {
+                if (successor->_pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                    return;
+
+                if (successor->_pinned_worker != nullptr)
+                    successor->_pinned_worker->deliver(successor);
+                else
+                    worker._jobs.push(successor);
+                released = true;
+            };
+
+            for (const auto successor : job->_successors)
+                release(successor);
+            for (const auto follower : job->_followers)
+                release(follower);
+        }
+
+        // Wake idle workers if there is something to steal, or if this was the
+        // last job so they can finish the cycle
+        const auto last = _outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        if (released || last)
+            signal_work();
+    }
+
+    void runner::pace(const time_point deadline) {
+        // Wake up a little early if we are going to spin the rest of the way
+        const auto spin = std::chrono::duration_cast<clock::duration>(duration(std::max(0.0, spin_window.load())));
+        const auto wake = deadline - spin;
+
+        switch (pacing.load()) {
+        case pacing_policy::sleep:
+            if (const auto remaining = wake - clock::now(); remaining > clock::duration::zero())
+                std::this_thread::sleep_for(remaining);
+            break;
+        case pacing_policy::timer:
+            _frame_timer.wait_until(wake);
+            break;
+        }
+
+        // Busy-wait for the rest of the frame
+        while (clock::now() < deadline)
+            cpu_relax();
+    }
 
-        // These jobs will run on the next sub-cycle
-        std::lock_guard lock2{ job->job_mutex };
-        for (const auto& child : job->children())
-            run_next.push_back(child);
+    void runner::record_jitter(const double interval) {
+        std::lock_guard lock{ _jitter_mutex };
+        _jitter_samples[_jitter_count % _jitter_samples.size()] = std::abs(interval - frame_delay);
+        _jitter_count++;
     }
 
-    void runner::wait_for_workers() const noexcept {
-        for (auto worker_id = 0u; worker_id < _worker_id_counter; worker_id++) {
-            worker* worker;
-            {
-                std::lock_guard lock{ _worker_pool_mutex };
-                const auto& worker_pair = _worker_pool.find(worker_id);
-                if (worker_pair == _worker_pool.end())
-                    break; // Handle synchronization edge case
-                worker = worker_pair->second.get();
+    double nearest_rank(const std::span<const double> sorted, const double p) {
+        const auto rank = static_cast<std::size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+        return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+    }
+
+    jitter_stats runner::frame_jitter() {
+        std::array<double, std::tuple_size_v<decltype(_jitter_samples)>> samples{};
+        std::size_t count;
+        {
+            std::lock_guard lock{ _jitter_mutex };
+            samples = _jitter_samples;
+            count = std::min(_jitter_count, samples.size());
+        }
+
+        if (count == 0)
+            return {};
+
+        const auto recent = std::span{ samples }.first(count);
+        std::ranges::sort(recent);
+
+        return { nearest_rank(recent, 0.5), nearest_rank(recent, 0.95), nearest_rank(recent, 0.99), recent.back() };
+    }
+
+    void runner::trace(const char* name, const char* category, const time_point begin, const time_point end,
+                       const char* arg_name, const std::uint64_t arg) {
+        _trace.record({ name, category, arg_name, arg, trace_timestamp(begin), trace_timestamp(end) });
+    }
+
+    void runner::flush_trace_requests() {
+        std::vector<std::string> requests{};
+        {
+            std::lock_guard lock{ _trace_mutex };
+            requests.swap(_trace_requests);
+            _trace_requested = false;
+        }
+
+        // A trace that can't be written is not worth stopping the scheduler for
+        for (const auto& path : requests) {
+            try {
+                write_trace_file(path);
+            }
+            catch (const std::exception& ex) {
+                std::cout << "trace dump failed: " << ex.what() << std::endl;
             }
-            worker->wait_cycle_finish();
         }
     }
 
-    void runner::runner_arbiter() {
-        // Double-buffer for the job collections
-        std::vector<std::shared_ptr<job>> jobs_1{};
-        std::vector<std::shared_ptr<job>> jobs_2{};
+    void runner::write_trace_file(const std::string& path) {
+        std::vector<trace_thread> threads{};
+        threads.push_back({ "arbiter", 0, &_trace });
+        for (const auto worker : _workers)
+            threads.push_back({ "worker " + std::to_string(worker->id()), worker->id() + 1, &worker->_trace });
+
+        std::ofstream stream{ path };
+        if (!stream)
+            throw std::runtime_error("Failed to open trace file " + path);
+        write_trace(stream, threads);
+    }
+
+    void runner::dump_trace(const std::string& path) {
+        {
+            std::lock_guard lock{ _trace_mutex };
+            if (_arbiter_running) {
+                _trace_requests.push_back(path);
+                _trace_requested = true;
+                return;
+            }
+        }
+
+        write_trace_file(path);
+    }
+
+    double runner::slice_budget() const noexcept {
+        const auto delay = frame_delay.load(std::memory_order_relaxed);
+        if (delay <= 0 || _frame_deadline == time_point::max())
+            return std::numeric_limits<double>::infinity();
 
+        // Always leave some budget, so a job that runs late still makes progress
+        const auto cap = delay * slice_share.load(std::memory_order_relaxed);
+        const auto remaining = std::chrono::duration_cast<duration>(_frame_deadline - clock::now()).count()
+            - defer_margin.load(std::memory_order_relaxed);
+        return std::clamp(remaining, cap / 16, cap);
+    }
+
+    void runner::spawn(worker& worker, task* task) noexcept {
+        // The spawning task is still outstanding, so the count can't have
+        // reached zero and let the other workers finish the sub-cycle
+        _outstanding.fetch_add(1, std::memory_order_acq_rel);
+        worker._jobs.push(task);
+        signal_work();
+    }
+
+    void runner::finish_task() noexcept {
+        if (_outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            signal_work();
+    }
+
+    void runner::runner_arbiter() {
         // Determines the next worker to use
         std::uint32_t next_worker_id{};
 
+        // The point where the current frame begins. Frames are laid out on a
+        // fixed timeline, so waking up late does not push every later frame back.
+        auto frame_begin = clock::now();
+
+        // Used to advance the simulation by the time that actually passed
+        auto previous_cycle_start = frame_begin;
+
         // Each of these cycles are rendered as a "full cycle",
         // defining a full frame in the scheduler
-        while (_active) {
-            time_point cycle_start;
-
-            // Acquire a lock on the root job collection and copy the jobs
-            // to a temporary buffer that we can safely use
-            {
-                std::lock_guard lock{ _root_jobs_mutex };
-                std::ranges::copy(_root_jobs, std::back_inserter(jobs_1));
-            }
-
+        while (_active && (frame_limit == 0 || _frame < frame_limit)) {
             // Save the start time of the cycle, we will use it later to
             // calculate the time delta between cycles
-            cycle_start = clock::now();
+            const auto cycle_start = clock::now();
+
+            // A frame that ran a little long is made up for by the next one, but
+            // if we fell more than a whole frame behind, catching up would only
+            // produce a burst of short frames, so the timeline starts over instead
+            const auto delay = frame_delay.load();
+            const auto frame_length = std::chrono::duration_cast<clock::duration>(duration(std::max(0.0, delay)));
+            if (delay <= 0 || cycle_start - frame_begin > frame_length)
+                frame_begin = cycle_start;
+            _frame_deadline = delay > 0 ? frame_begin + frame_length : time_point::max();
+
+            // Only rediscover the job tree if it was modified
+            if (_plan.version() != job::topology_version())
+                rebuild_plan();
+
+            // Pick up any workers that were pushed or popped since last cycle
+            refresh_workers();
+
+            // Scratch memory from the last frame is no longer in use
+            for (const auto worker : _workers)
+                worker->_arena.reset();
+
+            // Run the cycle in the requested mode
+            // The simulation steps first, so the frame sees the latest state
+            _cycle_mode = mode;
+            run_simulation(std::chrono::duration_cast<duration>(cycle_start - previous_cycle_start).count(), next_worker_id);
+            previous_cycle_start = cycle_start;
+            run_plan(_plan, _frame, next_worker_id);
+
+            // Write the execution delta
+            const auto cycle_end = clock::now();
+            const auto exec_delta = std::chrono::duration_cast<duration>(cycle_end - cycle_start).count();
 
-            // Traverse all jobs and assign them to workers
-            // This is the zeroth sub-cycle of the scheduler
-            for (auto& job : jobs_1)
-                 assign_job(job, next_worker_id, jobs_2);
+            // Grow or shrink the pool based on how busy the workers were
+            autoscale(exec_delta);
 
-            // Prepare the jobs buffer for the next sub-cycle by clearing it
-            // This buffer will be used for (n>1)th sub-cycle jobs
-            jobs_1.clear();
+            if (record_frame_times)
+                _frame_times.push_back(exec_delta);
 
-            // Wait for all workers to suspend (sub-cycle finished)
-            wait_for_workers();
+            // The workers are suspended, so their traces can be read safely
+            if (tracing.load(std::memory_order_relaxed))
+                trace("cycle", "cycle", cycle_start, cycle_end, "frame", _frame);
+            if (_trace_requested.load(std::memory_order_relaxed))
+                flush_trace_requests();
 
-            // This is the nth sub-cycle loop of the scheduler that assigns
-            // deferred jobs to workers
-            while (!jobs_2.empty()) {
-                for (auto& job : jobs_2)
-                    assign_job(job, next_worker_id, jobs_1);
-                
-                // Prepare the buffers for the next sub-cycle and wait for
-                // all workers to suspend (sub-cycle finished)
-                jobs_2.clear();
-                std::swap(jobs_1, jobs_2);
-                wait_for_workers();
-            }
+            // Wait for the next point on the timeline
+            if (delay > 0) {
+                const auto pace_start = clock::now();
+                pace(_frame_deadline);
+                frame_begin = _frame_deadline;
 
-            // Write the execution delta
-            const auto cycle_end = clock::now();
-            auto exec_delta = std::chrono::duration_cast<duration>(cycle_end - cycle_start).count();
-
-            // Calculate the remaining time. If we beat the frame delay, we
-            // are achieving the desired frame rate
-            auto remaining_time = std::max(0.0, frame_delay - exec_delta);
-            if (remaining_time > 0) {
-                exec_delta += remaining_time;
-                std::this_thread::sleep_for(duration(remaining_time));
+                if (tracing.load(std::memory_order_relaxed))
+                    trace("pace", "pace", pace_start, clock::now(), "frame", _frame);
             }
+            _frame++;
 
             // Write the cycle delta
-            cycle_delta = exec_delta;
+            cycle_delta = std::chrono::duration_cast<duration>(clock::now() - cycle_start).count();
+            if (delay > 0)
+                record_jitter(cycle_delta);
+        }
 
-            // Clear the temporary buffer and do a swap
-            jobs_2.clear();
-            std::swap(jobs_1, jobs_2);
+        // Requests made from now on are written right away by dump_trace
+        {
+            std::lock_guard lock{ _trace_mutex };
+            _arbiter_running = false;
+            if (tracing && !trace_path.empty())
+                _trace_requests.push_back(trace_path);
         }
 
-        // Pop all workers from the pool
+        // Write the trace while the workers are still around
+        flush_trace_requests();
+
+        // Pop all workers from the pool. We are no longer running a cycle, so
+        // they can be destroyed right away.
+        {
+            std::lock_guard lock{ _worker_pool_mutex };
+            _retired_workers.clear();
+        }
         while (pop_worker()) {}
+        _workers.clear();
+        _workers_version = ~0ull;
+
+        // Reaching the frame limit stops the scheduler as well
+        _active = false;
 
         // Report finished
         std::lock_guard lock{ _arbiter_close_mutex };
+        _arbiter_exited = true;
         _arbiter_close_cv.notify_all();
     }
 
@@ -200,52 +767,127 @@ namespace sched {
         stop();
     }
 
-    // Affinity generation could definitely be improved. For now, we just
-    // pin one thread to each core. This is not ideal because the OS can
-    // hog specific cores, but it's better than nothing.
+    void runner::build_affinity_slots() {
+        const auto& cpus = topology();
+        _affinity_slots.clear();
+
+        // The topology is sorted by NUMA node, cache domain and core, so CPUs
+        // that share one of them are adjacent. Each run of CPUs with the same
+        // key becomes one slot.
+        const auto group_by = [&](auto key) {
+            for (std::size_t i = 0; i < cpus.size(); i++) {
+                if (i == 0 || std::invoke(key, cpus[i]) != std::invoke(key, cpus[i - 1]))
+                    _affinity_slots.emplace_back();
+                _affinity_slots.back().set(cpus[i].id);
+            }
+        };
+
+        switch (pinning.load()) {
+        case pinning_policy::none:
+            break;
+        case pinning_policy::logical_core: {
+            // Rank each CPU among its SMT siblings, then hand out every rank 0
+            // CPU before any rank 1 CPU, and so on. This keeps workers off of
+            // shared cores for as long as possible.
+            std::vector<std::pair<std::uint32_t, std::size_t>> ranked{};
+            std::uint32_t rank = 0;
+            for (std::size_t i = 0; i < cpus.size(); i++) {
+                rank = i != 0 && cpus[i].core == cpus[i - 1].core ? rank + 1 : 0;
+                ranked.emplace_back(rank, i);
+            }
+            std::ranges::stable_sort(ranked, {}, &std::pair<std::uint32_t, std::size_t>::first);
 
-    // A better algorithm would be ideal, but this is not a priority. The
-    // scheduler actually runs pretty well with this affinity generation
-    // algorithm.
+            for (const auto index : ranked | std::views::values)
+                _affinity_slots.emplace_back().set(cpus[index].id);
+            break;
+        }
+        case pinning_policy::physical_core:
+            group_by(&platform::cpu_info::core);
+            break;
+        case pinning_policy::cache_domain:
+            group_by(&platform::cpu_info::cache);
+            break;
+        }
+
+        _affinity_slots_used.assign(_affinity_slots.size(), false);
+    }
 
     platform::affinity_mask runner::next_affinity_mask() {
-        // If there are no unused cores, we can't push a worker because
+        std::lock_guard lock{ _affinity_mutex };
+
+        // Without pinning, the OS handles affinity
+        if (_affinity_slots.empty())
+            return {};
+
+        // If there are no unused slots, we can't push a worker because
         // we ran out of cores to use, and pushing more workers would
         // be a waste of resources
-        if (_unused_cores.load() == 0)
+        const auto unused = std::ranges::find(_affinity_slots_used, false);
+        if (unused == _affinity_slots_used.end())
             throw std::runtime_error("No more cores available");
 
-        // Create a custom affinity mask bound to a the core located at
-        // the LSB that is set in the current mask
-        const auto worker_affinity = _unused_cores & ~(_unused_cores - 1);
+        *unused = true;
+        return _affinity_slots[std::distance(_affinity_slots_used.begin(), unused)];
+    }
 
-        // Remove the core from the unused core mask
-        _unused_cores &= ~worker_affinity;
+    void runner::release_affinity_mask(const platform::affinity_mask& mask) {
+        std::lock_guard lock{ _affinity_mutex };
 
-        // Return the affinity mask
-        return worker_affinity;
+        for (std::size_t i = 0; i < _affinity_slots.size(); i++) {
+            if (_affinity_slots_used[i] && _affinity_slots[i] == mask) {
+                _affinity_slots_used[i] = false;
+                return;
+            }
+        }
     }
 
     void runner::start(const bool floating, const std::optional<std::uint32_t> thread_count) {
         if (_active)
             throw std::runtime_error("Scheduler is already running");
 
-        auto worker_count = thread_count.value_or(_core_count);
-        if (floating) worker_count--; // Last core for the arbiter
+        // Generate the CPU sets for the pinning policy
+        {
+            std::lock_guard lock{ _affinity_mutex };
+            build_affinity_slots();
+        }
+
+        // Default to one worker per slot, or per logical core without pinning
+        const auto slot_count = static_cast<std::uint32_t>(_affinity_slots.size());
+        auto worker_count = thread_count.value_or(slot_count != 0 ? slot_count : _core_count);
+        if (floating && worker_count > 1) worker_count--; // Last core for the arbiter
 
         // Push initial workers to the pool
         for (auto i = 0u; i < worker_count; i++)
             push_worker();
 
+        // Reserve the frame times up front, so recording them doesn't allocate
+        _frame_times.clear();
+        if (record_frame_times)
+            _frame_times.reserve(frame_limit);
+
         // Set the active flag to true
         _active = true;
+        {
+            std::lock_guard lock{ _arbiter_close_mutex };
+            _arbiter_exited = false;
+        }
+
+        // Popped workers are retired to the arbiter, and trace dumps are left to
+        // it, from now on. This is set before the thread exists, so a dump made
+        // right after starting can't race the workers' trace rings.
+        {
+            std::lock_guard lock{ _trace_mutex };
+            _arbiter_running = true;
+        }
 
         // Create the arbiter thread
         std::thread arbiter_thread{ &runner::runner_arbiter, this };
 
         // Begin execution of the arbiter
         if (floating) {
-            platform::set_thread_affinity(arbiter_thread, next_affinity_mask());
+            // The arbiter is only pinned if there is a core left over for it
+            if (worker_count < slot_count)
+                platform::set_thread_affinity(arbiter_thread, next_affinity_mask());
             arbiter_thread.detach();
         }
         else {
@@ -260,9 +902,10 @@ namespace sched {
         // Set the active flag to false
         _active = false;
 
-        // Wait for the arbiter to stop
+        // Wait for the arbiter to stop. It may already have, if it was asked to
+        // stop from somewhere else.
         std::unique_lock lock{ _arbiter_close_mutex };
-        _arbiter_close_cv.wait(lock);
+        _arbiter_close_cv.wait(lock, [this] { return _arbiter_exited; });
     }
 
     void runner::signal_stop() {
@@ -271,10 +914,11 @@ namespace sched {
         _active = false;
     }
 
-    void runner::schedule(const std::shared_ptr<job>& to_schedule) {
+    void runner::schedule(const std::shared_ptr<job>& to_schedule, const job_lane lane) {
         // Acquire a lock on the root job collection and push the job
         std::lock_guard lock{ _root_jobs_mutex };
-        _root_jobs.push_back(to_schedule);
+        (lane == job_lane::simulation ? _simulation_jobs : _root_jobs).push_back(to_schedule);
+        job::invalidate_topology();
     }
 
     void runner::erase(const std::shared_ptr<job>& to_erase) {
@@ -287,19 +931,24 @@ namespace sched {
         // Acquire a lock on the root job collection
         std::lock_guard lock{ _root_jobs_mutex };
 
-        // Find the job in the collection
+        // Find the job in the collection of either lane
         // It's faster to do this without copying over since we're
         // going to traverse the collection here anyways. This prevents
         // our time complexity from being O(2n) and instead O(n)
-        const auto it = std::ranges::find(_root_jobs, to_erase);
-
-        // If the job is not in the collection, we can't erase it
-        if (it == _root_jobs.end())
-            throw std::runtime_error("Cannot find job");
+        for (auto* const roots : { &_root_jobs, &_simulation_jobs }) {
+            const auto it = std::ranges::find(*roots, to_erase);
+            if (it == roots->end())
+                continue;
+
+            // Transfer ownership. The job will destruct per RAII
+            auto extracted_job = std::move(*it);
+            roots->erase(it);
+            job::invalidate_topology();
+            return;
+        }
 
-        // Transfer ownership. The job will destruct per RAII
-        auto extracted_job = std::move(*it);
-        _root_jobs.erase(it);
+        // If the job is not in either collection, we can't erase it
+        throw std::runtime_error("Cannot find job");
     }
 
     std::size_t runner::job_count() {
@@ -308,11 +957,13 @@ namespace sched {
 
         {
             std::lock_guard lock{ _root_jobs_mutex };
-            size = _root_jobs.size();
+            size = _root_jobs.size() + _simulation_jobs.size();
 
-            for (const auto& job : _root_jobs) {
-                size += job->children().size();
-                sub_jobs.push_back(job);
+            for (const auto* const roots : { &_root_jobs, &_simulation_jobs }) {
+                for (const auto& job : *roots) {
+                    size += job->children().size();
+                    sub_jobs.push_back(job);
+                }
             }
         }
 
@@ -5,27 +5,119 @@
 #include <atomic>
 #include <mutex>
 #include <chrono>
+#include <optional>
+#include <array>
+#include <span>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <tbb/concurrent_hash_map.h>
 
+#include "barrier.hpp"
+#include "execution_plan.hpp"
+#include "trace.hpp"
 #include "platform/current.hpp"
-#include "platform/linux.hpp"
 
 namespace sched {
     // Forward declarations
     class worker;
     class job;
+    class task;
+
+    // Determines how the runner walks the job tree in a cycle
+    enum class execution_mode {
+        // Every level of the tree is a sub-cycle, and each sub-cycle waits for
+        // the previous one to finish entirely
+        sub_cycle,
+
+        // Each job counts its pending parents, and becomes runnable as soon as
+        // they complete. There is only one barrier per cycle.
+        graph
+    };
+
+    // Determines how often the jobs under a root job run
+    enum class job_lane {
+        // Run once per frame, at the frame rate
+        frame,
+
+        // Run on a fixed timestep. Depending on how much time has passed, this
+        // runs zero or more times per frame, before the frame lane.
+        simulation
+    };
+
+    // Determines how the arbiter places jobs on workers
+    enum class placement_policy {
+        // Hand jobs to workers in order, one at a time
+        round_robin,
+
+        // Place the most expensive jobs first, each on the worker with the least
+        // measured work so far (longest-processing-time-first bin packing)
+        longest_first
+    };
+
+    // Determines how workers are pinned to CPUs
+    enum class pinning_policy {
+        // Let the OS schedule workers freely
+        none,
+
+        // One worker per logical CPU. Every physical core gets a worker before
+        // any SMT siblings are used.
+        logical_core,
+
+        // One worker per physical core, pinned to the core's SMT siblings
+        physical_core,
+
+        // One worker per last level (L3) cache domain, pinned to the CPUs in it
+        cache_domain
+    };
+
+    // Determines how the arbiter waits out the rest of a frame
+    enum class pacing_policy {
+        // Sleep for the remaining time. Overshoots by however long the OS takes
+        // to wake the thread.
+        sleep,
+
+        // Wait for the frame's absolute deadline on a high resolution timer
+        timer
+    };
+
+    // Percentiles of how far frame intervals strayed from the frame delay, in seconds
+    struct jitter_stats {
+        double p50{};
+        double p95{};
+        double p99{};
+        double max{};
+    };
+
+    // Get a percentile of samples sorted in ascending order by the nearest rank
+    // method, which always picks one of the samples. There has to be at least one.
+    double nearest_rank(std::span<const double> sorted, double p);
 
     // Runner class used to schedule jobs
     // This class is responsible for the creation of workers and the delegation of jobs to workers
     class runner {
-        // The amount of logical cores available on the system
+    public:
+        // The steady clock never jumps, so frame deadlines can be laid out on it
+		using clock = std::chrono::steady_clock;
+
+		// These are just aliases for the types; saves space
+		using time_point = clock::time_point;
+		using duration = std::chrono::duration<double>;
+
+    private:
+        // The amount of logical cores available to the process
         static std::uint32_t _core_count;
 
-        // A bitmask that represents the cores that are available for use
-        // Initially set the mask to have all bits set
-        std::atomic<platform::affinity_mask> _unused_cores = (1 << _core_count) - 1;
+        // The CPU sets generated from the topology by the pinning policy. Each
+        // worker (and a floating arbiter) is pinned to the first unused slot.
+        std::vector<platform::affinity_mask> _affinity_slots;
+
+        // Determines which affinity slots are in use
+        std::vector<bool> _affinity_slots_used;
+
+        // Ensures mutual exclusion of the affinity slots
+        std::mutex _affinity_mutex;
 
         // A number that represents the next worker ID
         std::atomic<std::uint32_t> _worker_id_counter;
@@ -36,15 +128,116 @@ namespace sched {
         // Ensures mutual exclusion of the worker pool
     	mutable std::mutex _worker_pool_mutex;
 
+        // Incremented whenever a worker is pushed or popped (guarded by the pool mutex)
+        std::uint64_t _worker_pool_version{};
+
+        // Workers that were popped while the arbiter was running. The arbiter
+        // destroys them once the cycle they may be part of is over.
+        std::vector<std::unique_ptr<worker>> _retired_workers;
+
+        // A snapshot of the worker pool taken by the arbiter at the start of every
+        // cycle. This is only modified while all workers are suspended, so workers
+        // may read it without locking (used for work stealing).
+        std::vector<worker*> _workers;
+
+        // The pool version the snapshot was taken from
+        std::uint64_t _workers_version{ ~0ull };
+
+        // Determines if the arbiter is running cycles on the worker pool
+        std::atomic<bool> _arbiter_running{ false };
+
+        // Sliding window of the pool's load, used for elastic scaling
+        std::vector<double> _load_window;
+
+        // The sum of the loads in the window
+        double _load_sum{};
+
+        // The amount of loads recorded since the window was last reset
+        std::uint32_t _load_samples{};
+
         // A collection of zeroth-sub-cycle jobs that are scheduled to be executed
         // TODO: We can potentially use a concurrent data structure here as well,
         //       however, it is not necessary as the arbiter is quite fast as is.
         //       This idea is, however, worth revisiting in the future.
         std::vector<std::shared_ptr<job>> _root_jobs;
 
+        // The root jobs of the simulation lane, also guarded by the root job mutex
+        std::vector<std::shared_ptr<job>> _simulation_jobs;
+
         // Ensures mutual exclusion of the root job collection
     	std::mutex _root_jobs_mutex;
 
+        // The job tree compiled into a flat plan. Rebuilt by the arbiter only when
+        // the topology version changes, and otherwise reused every cycle.
+        execution_plan _plan;
+
+        // The plan of the simulation lane, rebuilt along with the frame plan
+        execution_plan _simulation_plan;
+
+        // Simulation time that has passed but has not been stepped yet, in seconds
+        // Only touched by the arbiter
+        double _tick_accumulator{};
+
+        // The amount of simulation steps run so far. Only written by the arbiter
+        // while all workers are suspended.
+        std::uint64_t _tick{};
+
+        // How far the frame is between the last two simulation steps
+        std::atomic<double> _alpha{ 1.0 };
+
+        // The execution mode used by the cycle in progress
+        // Only written by the arbiter while all workers are suspended
+        execution_mode _cycle_mode{ execution_mode::graph };
+
+        // The amount of jobs and spawned tasks in the sub-cycle that have not
+        // completed yet. Idle workers keep looking for work until it drops to zero.
+        std::atomic<std::size_t> _outstanding{};
+
+        // Every worker arrives at this barrier once it finishes a sub-cycle
+        barrier _cycle_barrier{};
+
+        // Adaptive spin state used by the arbiter while waiting on the barrier
+        spinner _arbiter_spinner{};
+
+        // Scratch buffers used for cost based placement. Kept around so steady
+        // state cycles do not allocate.
+        std::vector<job*> _placement_order;
+        std::vector<job*> _pinned_order;
+        std::vector<std::uint32_t> _placement_targets;
+        std::vector<std::pair<double, std::uint32_t>> _worker_loads;
+
+        // The point in time the cycle in progress should be done by
+        // Only written by the arbiter while all workers are suspended
+        time_point _frame_deadline{ time_point::max() };
+
+        // Incremented whenever work is released mid-cycle or the last job
+        // completes. Idle workers park on this value.
+        std::atomic<std::uint32_t> _work_signal{ 0 };
+
+        // The amount of workers parked on the work signal
+        std::atomic<std::uint32_t> _idle_workers{ 0 };
+
+        // Waits for frame deadlines when pacing with a timer
+        platform::frame_timer _frame_timer{};
+
+        // The most recent frame interval errors, used as a ring buffer
+        std::array<double, 240> _jitter_samples{};
+        std::size_t _jitter_count{};
+        std::mutex _jitter_mutex;
+
+        // The arbiter's trace events
+        trace_buffer _trace{};
+
+        // The amount of cycles run so far. Only written by the arbiter while all
+        // workers are suspended.
+        std::uint64_t _frame{};
+
+        // Paths that dump_trace was called with, written by the arbiter between
+        // two cycles while the workers are suspended
+        std::vector<std::string> _trace_requests;
+        std::atomic<bool> _trace_requested{ false };
+        std::mutex _trace_mutex;
+
         // Determines if the scheduler is running
         std::atomic<bool> _active{ false };
 
@@ -54,15 +247,110 @@ namespace sched {
 		// Mutex used for waiting on the arbiter to exit
 		std::mutex _arbiter_close_mutex{};
 
+		// Determines if the arbiter has exited, guarded by the close mutex
+		bool _arbiter_exited{ true };
+
+		// The execution time of every cycle, if frame times are recorded
+		std::vector<double> _frame_times;
+
+        // Generate the affinity slots from the topology and pinning policy
+        void build_affinity_slots();
+
         // Get the next thread affinity mask
         platform::affinity_mask next_affinity_mask();
 
-        // Internal function used to assign a job to a worker
-        void assign_job(const std::shared_ptr<job>& job, std::uint32_t& next_worker_id,
-                        std::vector<std::shared_ptr<sched::job>>& run_next) noexcept;
+        // Return an affinity mask to the unused slots
+        void release_affinity_mask(const platform::affinity_mask& mask);
+
+        // Take a snapshot of the worker pool for the next cycle
+        void refresh_workers();
+
+        // Remove the newest worker from the pool and hand it to the caller
+        std::unique_ptr<worker> take_worker();
+
+        // Get the largest amount of workers the pool may grow to
+        std::uint32_t worker_limit();
+
+        // Measure the load of the cycle and resize the pool if needed
+        void autoscale(double exec_delta);
+
+        // Record a span in the arbiter's trace
+        void trace(const char* name, const char* category, time_point begin, time_point end,
+                   const char* arg_name = nullptr, std::uint64_t arg = 0);
+
+        // Write the trace for every pending dump_trace call
+        void flush_trace_requests();
+
+        // Write the trace of the arbiter and the current workers to a file
+        void write_trace_file(const std::string& path);
+
+        // Wait until the frame deadline according to the pacing policy
+        void pace(time_point deadline);
+
+        // Record how far a frame interval strayed from the frame delay
+        void record_jitter(double interval);
+
+        // Place a set of jobs according to the placement policy, using each
+        // job's placement cost as its weight. Each worker runs its critical jobs
+        // first and its best-effort jobs last. Pinned jobs go to their own worker
+        // and count towards its load.
+        void place_jobs(std::span<job* const> jobs, std::uint32_t& next_worker_id);
+
+        // Find the worker a job is pinned to in the current pool, or nullptr if
+        // the job may run anywhere
+        worker* pinned_worker(const job& job) const noexcept;
+
+        // Resolve the pins of the jobs that run in the next sub-cycle, and tell
+        // each worker how many pinned jobs to wait for
+        void route_pinned(std::span<job* const> jobs) noexcept;
+
+        // Determine if a best-effort job should be put off to the next cycle
+        // because running it would likely miss the frame deadline
+        bool should_defer(const job& job) const noexcept;
+
+        // Recompile the execution plans from the root jobs and erase exited jobs
+        void rebuild_plan();
+
+        // Pick a phase for every job in the plan whose divisor changed, spreading
+        // the measured cost of jobs with the same divisor evenly over the phases
+        static void assign_phases(const execution_plan& plan);
+
+        // Run a plan once in the execution mode of the cycle. The lane cycle is
+        // the frame or simulation step number, used to find the jobs that are due.
+        void run_plan(execution_plan& plan, std::uint64_t lane_cycle, std::uint32_t& next_worker_id);
+
+        // Run a plan level by level, with a barrier between each sub-cycle
+        void run_sub_cycles(execution_plan& plan, std::uint32_t& next_worker_id);
+
+        // Run a plan as a dependency graph, with a single barrier at the end
+        void run_graph(execution_plan& plan, std::uint32_t& next_worker_id);
+
+        // Step the simulation lane for the time that passed since the last cycle
+        void run_simulation(double elapsed, std::uint32_t& next_worker_id);
+
+        // Called by a worker once it has executed a job. In graph mode, this
+        // releases the children whose parents have all completed onto the
+        // worker's deque, or into the mailbox of the worker they are pinned to.
+        void complete_job(worker& worker, job* job) noexcept;
+
+        // Push a task created mid-cycle onto a worker's deque, where idle workers
+        // can steal it. Must be called from the worker's own thread.
+        void spawn(worker& worker, task* task) noexcept;
+
+        // Called once a spawned task has completed
+        void finish_task() noexcept;
+
+        // Notify idle workers that there may be new work or that the cycle is done
+        void signal_work() noexcept;
+
+        // Called by an idle worker to wait until the work signal changes
+        void wait_for_work(spinner& spinner, std::uint32_t seen_signal) noexcept;
+
+        // Resume all workers to begin a sub-cycle
+        void wake_workers() noexcept;
 
         // Wait until all workers suspend
-        void wait_for_workers() const noexcept;
+        void wait_for_workers() noexcept;
 
         // The main loop of the scheduler
         void runner_arbiter();
@@ -71,17 +359,10 @@ namespace sched {
         // Push a worker onto the pool
         void push_worker();
 
-        // Pop a worker from the pool
+        // Pop the newest worker from the pool
         // Returns true if a worker existed and was popped
         bool pop_worker();
 
-        // High resolution clock is used to determine more accurate time deltas between cycles
-		using clock = std::chrono::high_resolution_clock;
-
-		// These are just aliases for the types; saves space
-		using time_point = clock::time_point;
-		using duration = std::chrono::duration<double>;
-
         ~runner();
 
         // The amount of time a frame should last. Zero means that the scheduler should
@@ -91,9 +372,131 @@ namespace sched {
         // The time delta between two cycles
         std::atomic<double> cycle_delta{};
 
-        // The amount of logical cores available on the system
+        // The time in seconds to keep free before the frame deadline. Best-effort
+        // jobs whose measured cost does not fit before it are deferred.
+        std::atomic<double> defer_margin{ 0.001 };
+
+        // The amount of cycles in a row a best-effort job may be deferred before
+        // it runs regardless of the deadline, so it can't starve
+        std::atomic<std::uint32_t> max_deferrals{ 8 };
+
+        // The largest share of the frame delay that one slice of a budgeted job
+        // may take, even if more of the frame is left
+        std::atomic<double> slice_share{ 0.25 };
+
+        // The fixed timestep of the simulation lane, in seconds. Zero runs the
+        // simulation lane once per frame, right before the frame lane.
+        std::atomic<double> tick_delay{ 0.0 };
+
+        // The most simulation steps run in one frame. When the simulation falls
+        // further behind than this, the rest of the time is dropped and game time
+        // slows down instead of the frame rate collapsing.
+        std::atomic<std::uint32_t> max_ticks{ 4 };
+
+        // The amount of cycles to run before the scheduler stops by itself. Zero
+        // means there is no limit. Must be set before start.
+        std::uint64_t frame_limit{ 0 };
+
+        // Determines if the execution time of every cycle is recorded. Must be
+        // set before start.
+        bool record_frame_times{ false };
+
+        // Determines how the arbiter waits for the next frame
+        std::atomic<pacing_policy> pacing{ pacing_policy::timer };
+
+        // The time before each frame deadline, in seconds, that the arbiter
+        // busy-waits instead of sleeping. This trades CPU time for precision.
+        std::atomic<double> spin_window{ 0.0 };
+
+        // Determines if the arbiter and workers record what they are doing. When
+        // disabled, this costs a single relaxed load per job.
+        std::atomic<bool> tracing{ false };
+
+        // Where the trace is written when the scheduler stops, if tracing is
+        // enabled. Empty means it is not written. Must be set before start.
+        std::string trace_path{};
+
+        // Determines how the job tree is executed. Takes effect on the next cycle.
+        std::atomic<execution_mode> mode{ execution_mode::graph };
+
+        // The amount of times a waiting thread checks its condition before it
+        // parks. Higher values lower wake latency at the cost of idle CPU time,
+        // and zero parks right away.
+        std::atomic<std::uint32_t> spin_count{ 1024 };
+
+        // Determines if the runner adds workers when the pool is saturated and
+        // the frame is CPU-bound, and retires them when they sit idle
+        std::atomic<bool> elastic{ false };
+
+        // The smallest amount of workers an elastic pool shrinks to
+        std::atomic<std::uint32_t> min_workers{ 1 };
+
+        // The largest amount of workers an elastic pool grows to. Zero means one
+        // per affinity slot (or logical core without pinning). With pinning, the
+        // pool never grows past the free affinity slots.
+        std::atomic<std::uint32_t> max_workers{ 0 };
+
+        // The amount of cycles the load is averaged over before resizing
+        std::atomic<std::uint32_t> scale_window{ 120 };
+
+        // The load (busy time over the frame budget) above which a worker is added
+        std::atomic<double> grow_utilization{ 0.85 };
+
+        // The load below which a worker is retired. The load the smaller pool
+        // would have is compared, so this must stay well below the grow threshold.
+        std::atomic<double> shrink_utilization{ 0.5 };
+
+        // Determines how jobs are distributed among the workers
+        std::atomic<placement_policy> placement{ placement_policy::longest_first };
+
+        // The weight of a new sample in each job's smoothed execution cost
+        std::atomic<double> cost_smoothing{ 0.2 };
+
+        // Determines if idle workers may steal jobs from busy workers in the same
+        // sub-cycle. When disabled, jobs stay on the worker they were assigned to.
+        std::atomic<bool> work_stealing{ true };
+
+        // Determines how workers are pinned to CPUs. Takes effect on start.
+        std::atomic<pinning_policy> pinning{ pinning_policy::logical_core };
+
+        // Get the number of the cycle in progress
+        // Only safe to be called from jobs, since the arbiter increments it between cycles
+        [[nodiscard]] std::uint64_t frame() const noexcept { return _frame; }
+
+        // Get the time a budgeted job may spend on a slice right now, in seconds.
+        // This is what is left of the frame (minus the defer margin), capped by
+        // the slice share. Without a frame delay, there is no budget to keep to.
+        // Only meaningful when called from jobs.
+        [[nodiscard]] double slice_budget() const noexcept;
+
+        // Get the number of the simulation step in progress
+        // Only safe to be called from jobs, since the arbiter increments it between steps
+        [[nodiscard]] std::uint64_t tick() const noexcept { return _tick; }
+
+        // Get how far the current frame is between the previous and the latest
+        // simulation step, from zero to one. The frame lane can use this to
+        // interpolate between the two states.
+        [[nodiscard]] double alpha() const noexcept { return _alpha.load(std::memory_order_relaxed); }
+
+        // Get the execution time of every cycle of the last run, in seconds, if
+        // record_frame_times was set. Only safe to be called once the scheduler
+        // has stopped.
+        [[nodiscard]] const std::vector<double>& frame_times() const noexcept { return _frame_times; }
+
+        // Get the jitter of recent frames, relative to the frame delay
+        jitter_stats frame_jitter();
+
+        // Write the recorded trace to a file as Chrome trace-event JSON, which can
+        // be opened with Perfetto or chrome://tracing. While the scheduler is
+        // running, the file is written by the arbiter after the current cycle.
+        void dump_trace(const std::string& path);
+
+        // The amount of logical cores available to the process
         static auto core_count() { return _core_count; }
 
+        // Get the logical CPUs available to the process, discovered once
+        static const std::vector<platform::cpu_info>& topology();
+
         // Start the task scheduler
         // The floating parameter determines if the scheduler should be detached
         void start(bool floating, std::optional<std::uint32_t> thread_count = std::nullopt);
@@ -106,8 +509,8 @@ namespace sched {
         // This is OK to be called from a worker thread
         void signal_stop();
 
-        // Schedule a job to be executed
-        void schedule(const std::shared_ptr<job>& to_schedule);
+        // Schedule a job to be executed in the given lane
+        void schedule(const std::shared_ptr<job>& to_schedule, job_lane lane = job_lane::frame);
 
         // Erase a job from the scheduler
         void erase(const std::shared_ptr<job>& to_erase);
@@ -0,0 +1,19 @@
+#pragma once
+
+namespace sched {
+    // Forward declarations
+    class worker;
+
+    // The smallest unit of work a worker can execute
+    // Jobs are tasks that the runner schedules every cycle, while other tasks (such
+    // as the pieces of a parallel_for) only live for part of one.
+    class task {
+    public:
+        // Execute the task on the given worker
+        virtual void run(sched::worker& worker) = 0;
+
+    protected:
+        // Tasks are never owned through this type
+        ~task() = default;
+    };
+}
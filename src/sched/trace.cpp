@@ -0,0 +1,95 @@
+#include "trace.hpp"
+
+#include <cstdlib>
+#include <iomanip>
+
+#if defined(__GNUG__)
+#   include <cxxabi.h>
+#endif
+
+namespace sched {
+    // Get a readable version of a type name
+    static std::string demangle(const char* name) {
+#if defined(__GNUG__)
+        int status = 0;
+        const std::unique_ptr<char, decltype(&std::free)> demangled{
+            abi::__cxa_demangle(name, nullptr, nullptr, &status), &std::free };
+        if (status == 0 && demangled)
+            return demangled.get();
+#endif
+        // MSVC type names are readable already, apart from the prefix
+        std::string result{ name };
+        for (const auto prefix : { "class ", "struct " }) {
+            if (result.starts_with(prefix))
+                return result.substr(std::char_traits<char>::length(prefix));
+        }
+        return result;
+    }
+
+    // Write a string as a JSON string literal
+    static void write_string(std::ostream& stream, const std::string& value) {
+        stream << '"';
+        for (const auto c : value) {
+            if (c == '"' || c == '\\')
+                stream << '\\';
+            stream << c;
+        }
+        stream << '"';
+    }
+
+    void trace_buffer::record(const trace_event& event) {
+        if (!_events)
+            _events = std::make_unique<trace_event[]>(capacity);
+
+        // The release publishes the event (and the allocation) to the reader
+        const auto head = _head.load(std::memory_order_relaxed);
+        _events[head & (capacity - 1)] = event;
+        _head.store(head + 1, std::memory_order_release);
+    }
+
+    void trace_buffer::collect(std::vector<trace_event>& events) const {
+        const auto head = _head.load(std::memory_order_acquire);
+        const auto first = head > capacity ? head - capacity : 0;
+        for (auto i = first; i < head; i++)
+            events.push_back(_events[i & (capacity - 1)]);
+    }
+
+    void write_trace(std::ostream& stream, const std::vector<trace_thread>& threads) {
+        stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+        auto first = true;
+        const auto separate = [&] {
+            if (!first)
+                stream << ",\n";
+            first = false;
+        };
+
+        // Timestamps are written in microseconds
+        stream << std::fixed << std::setprecision(3);
+
+        std::vector<trace_event> events{};
+        for (const auto& thread : threads) {
+            separate();
+            stream << R"({"name":"thread_name","ph":"M","pid":0,"tid":)" << thread.id << R"(,"args":{"name":)";
+            write_string(stream, thread.name);
+            stream << "}}";
+
+            events.clear();
+            thread.buffer->collect(events);
+            for (const auto& event : events) {
+                separate();
+                stream << R"({"name":)";
+                write_string(stream, event.type_name ? demangle(event.name) : event.name);
+                stream << R"(,"cat":")" << event.category
+                       << R"(","ph":"X","pid":0,"tid":)" << thread.id
+                       << R"(,"ts":)" << static_cast<double>(event.begin) / 1000.0
+                       << R"(,"dur":)" << static_cast<double>(event.end - event.begin) / 1000.0;
+                if (event.arg_name != nullptr)
+                    stream << R"(,"args":{")" << event.arg_name << "\":" << event.arg << '}';
+                stream << '}';
+            }
+        }
+
+        stream << "]}\n";
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace sched {
+    // Convert a time point to a trace timestamp, in nanoseconds
+    inline std::int64_t trace_timestamp(const std::chrono::steady_clock::time_point time) noexcept {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    // A span of time recorded by the scheduler
+    struct trace_event {
+        // What was running. Either a static string, or a mangled type name when
+        // type_name is set.
+        const char* name{};
+
+        // The kind of span, such as "job" or "barrier"
+        const char* category{};
+
+        // Extra information about the span, shown next to it in the viewer
+        const char* arg_name{};
+        std::uint64_t arg{};
+
+        // Timestamps on the runner clock, in nanoseconds
+        std::int64_t begin{};
+        std::int64_t end{};
+
+        // Determines if the name has to be demangled
+        bool type_name{};
+    };
+
+    // A ring buffer of trace events written by a single thread
+    // Recording never locks or allocates (other than once, on the first event).
+    // Once the buffer is full, the oldest events are overwritten.
+    class trace_buffer {
+        // The amount of events kept, a power of two
+        static constexpr std::uint64_t capacity = 1 << 14;
+
+        // Allocated when the first event is recorded, so threads that never
+        // record anything don't pay for the buffer
+        std::unique_ptr<trace_event[]> _events;
+
+        // The amount of events recorded so far
+        std::atomic<std::uint64_t> _head{ 0 };
+
+    public:
+        // Record an event. Only safe to be called from the owning thread.
+        void record(const trace_event& event);
+
+        // Copy the events that are still in the buffer, oldest first. This must
+        // not race the owning thread recording events.
+        void collect(std::vector<trace_event>& events) const;
+    };
+
+    // A named thread's events, as passed to write_trace
+    struct trace_thread {
+        std::string name;
+        std::uint32_t id{};
+        const trace_buffer* buffer{};
+    };
+
+    // Write the events of the given threads as Chrome trace-event JSON, which can
+    // be opened with Perfetto or chrome://tracing
+    void write_trace(std::ostream& stream, const std::vector<trace_thread>& threads);
+}
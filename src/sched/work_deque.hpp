@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace sched {
+    // Chase-Lev work-stealing deque
+    // The owning thread pushes and pops at the bottom while any other thread may
+    // steal from the top. Based on "Correct and Efficient Work-Stealing for Weak
+    // Memory Models" (Le et al., 2013).
+    template <class T>
+    class work_deque {
+        static_assert(std::is_trivially_copyable_v<T>, "work_deque items must be trivially copyable");
+
+        // Circular buffer holding the items. Grows when the owner runs out of space.
+        struct ring {
+            std::int64_t capacity;
+            std::int64_t mask;
+            std::unique_ptr<std::atomic<T>[]> slots;
+
+            explicit ring(const std::int64_t capacity)
+                : capacity(capacity), mask(capacity - 1), slots(new std::atomic<T>[capacity]) {}
+
+            T load(const std::int64_t index) const noexcept {
+                return slots[index & mask].load(std::memory_order_relaxed);
+            }
+
+            void store(const std::int64_t index, T item) noexcept {
+                slots[index & mask].store(item, std::memory_order_relaxed);
+            }
+        };
+
+        // Index of the next item to be stolen
+        alignas(64) std::atomic<std::int64_t> _top{ 0 };
+
+        // Index of the next free slot on the owner's end
+        alignas(64) std::atomic<std::int64_t> _bottom{ 0 };
+
+        // The buffer currently in use
+        std::atomic<ring*> _ring;
+
+        // Every buffer ever allocated. Old buffers are kept alive until the deque is
+        // destroyed because a thief may still be reading from them.
+        std::vector<std::unique_ptr<ring>> _rings;
+
+        // Double the size of the buffer, copying over the live items (owner only)
+        ring* grow(ring* current, const std::int64_t top, const std::int64_t bottom) {
+            auto next = std::make_unique<ring>(current->capacity * 2);
+            for (auto i = top; i < bottom; i++)
+                next->store(i, current->load(i));
+
+            const auto raw_next = next.get();
+            _rings.push_back(std::move(next));
+            _ring.store(raw_next, std::memory_order_release);
+            return raw_next;
+        }
+
+    public:
+        // Capacity must be a power of two
+        explicit work_deque(const std::int64_t capacity = 64) {
+            _rings.push_back(std::make_unique<ring>(capacity));
+            _ring.store(_rings.back().get(), std::memory_order_relaxed);
+        }
+
+        work_deque(const work_deque&) = delete;
+        work_deque& operator=(const work_deque&) = delete;
+
+        // Push an item onto the owner's end of the deque
+        void push(T item) {
+            const auto bottom = _bottom.load(std::memory_order_relaxed);
+            const auto top = _top.load(std::memory_order_acquire);
+            auto current = _ring.load(std::memory_order_relaxed);
+
+            if (bottom - top > current->capacity - 1)
+                current = grow(current, top, bottom);
+
+            current->store(bottom, item);
+            std::atomic_thread_fence(std::memory_order_release);
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+
+        // Pop an item from the owner's end of the deque
+        std::optional<T> pop() noexcept {
+            const auto bottom = _bottom.load(std::memory_order_relaxed) - 1;
+            const auto current = _ring.load(std::memory_order_relaxed);
+            _bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto top = _top.load(std::memory_order_relaxed);
+
+            // The deque was already empty, restore the bottom index
+            if (top > bottom) {
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+                return std::nullopt;
+            }
+
+            auto item = current->load(bottom);
+            if (top != bottom)
+                return item;
+
+            // This is the last item, so we have to race the thieves for it
+            const auto won = _top.compare_exchange_strong(
+                top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+
+            if (!won)
+                return std::nullopt;
+            return item;
+        }
+
+        // Steal an item from the other end of the deque. This may fail when racing
+        // another thief or the owner, even though the deque is not empty.
+        std::optional<T> steal() noexcept {
+            auto top = _top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const auto bottom = _bottom.load(std::memory_order_acquire);
+
+            if (top >= bottom)
+                return std::nullopt;
+
+            const auto current = _ring.load(std::memory_order_acquire);
+            auto item = current->load(top);
+
+            if (!_top.compare_exchange_strong(
+                top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return std::nullopt;
+            return item;
+        }
+
+        // Estimate the amount of items in the deque
+        [[nodiscard]] std::int64_t size() const noexcept {
+            const auto bottom = _bottom.load(std::memory_order_relaxed);
+            const auto top = _top.load(std::memory_order_relaxed);
+            return bottom > top ? bottom - top : 0;
+        }
+
+        // Get the index of the owner's end. Items pushed afterwards are stored at
+        // or above it. Only meaningful to the owner.
+        [[nodiscard]] std::int64_t bottom() const noexcept {
+            return _bottom.load(std::memory_order_relaxed);
+        }
+
+        // Estimate if the deque is empty
+        [[nodiscard]] bool empty() const noexcept {
+            return size() == 0;
+        }
+    };
+}
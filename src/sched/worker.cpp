@@ -1,26 +1,28 @@
 #include "worker.hpp"
 
 #include <iostream>
+#include <typeinfo>
 
 #include "runner.hpp"
 #include "job.hpp"
 
 namespace sched {
+    thread_local worker* worker::_current = nullptr;
+
     void worker::worker_main() {
-        // Create a lock at first, because creating locks could be
-        // expensive and we don't want to do it every cycle, especially
-        // since this section of code may run more than 2x per frame
-        std::unique_lock lock(mutex, std::defer_lock);
+        // The last wake signal that we have handled
+        std::uint32_t seen_signal = 0;
+
+        // Let code running in our jobs find the worker
+        _current = this;
 
         try {
             // Each of these cycles are rendered as a "sub-cycle"
             // They consist of one portion of a frame
             while (true) {
-                // Suspend until we are woken up
-                {
-                    std::lock_guard guard(lock);
-                    _wake_cv.wait(lock, [this] { return _awake.load() || !_active; });
-                }
+                // Suspend until we are woken up. We spin for a little while
+                // before parking since the next sub-cycle usually follows soon.
+                seen_signal = spin_wait(_wake_signal, seen_signal, _wake_spinner, _runner->spin_count);
 
                 // Activity check
                 if (!_active)
@@ -30,111 +32,286 @@ namespace sched {
                 // calculate the time delta between cycles
                 const auto cycle_start = runner::clock::now();
 
-                // Traverse all jobs and execute them
-                std::shared_ptr<job> current_job;
-                while (_jobs.try_pop(current_job)) {
-                    try {
-                        current_job->execute();
-                    }
-                    catch (const std::exception& ex) {
-                        // TODO: Better error handling
-                        std::cout << "job execution exception: " << ex.what() << std::endl;
-                    }
+                // Traverse all tasks and execute them. Once our own deque runs
+                // dry we help out the rest of the pool before suspending.
+                task* current_task;
+                while ((current_task = next_task()) != nullptr) {
+                    // Tasks that are run while helping inside of this one are
+                    // already covered by this measurement
+                    _task_start = runner::clock::now();
+                    _task_end = {};
+                    current_task->run(*this);
+                    const auto task_end = _task_end != runner::time_point{} ? _task_end : runner::clock::now();
+                    _busy_time += std::chrono::duration_cast<runner::duration>(task_end - _task_start).count();
                 }
 
                 // Write the cycle delta
                 const auto cycle_end = runner::clock::now();
                 cycle_delta = std::chrono::duration_cast<runner::duration>(cycle_end - cycle_start).count();
 
-                // Set the awake flag to false and notify that we are done
-                _awake = false;
-                {
-                    std::lock_guard guard(lock);
-                    _wake_cv.notify_one();
-                }
+                if (_runner->tracing.load(std::memory_order_relaxed))
+                    _trace.record({ "sub-cycle", "cycle", "frame", _runner->_frame, trace_timestamp(cycle_start), trace_timestamp(cycle_end) });
+
+                // Report that we are done with the sub-cycle
+                _runner->_cycle_barrier.arrive();
             }
         }
         catch (const std::exception& ex) {
             // TODO: Better error handling
             std::cout << "worker crashed lol: " << ex.what() << std::endl;
         }
+    }
+
+    void worker::execute_job(job& job) {
+        // The job may have been stolen from another worker
+        job._worker.store(this, std::memory_order_relaxed);
+
+        // Skip the job if it is not due, or put it off to the next cycle if it
+        // would make the frame late. Its children depend on it, so they are
+        // skipped along with it.
+        auto skip = job._skipped.load(std::memory_order_relaxed);
+        if (!skip && job.priority() == job_priority::best_effort && _runner->should_defer(job)) {
+            job._deferrals++;
+            skip = true;
+
+            if (_runner->tracing.load(std::memory_order_relaxed)) {
+                const auto now = trace_timestamp(runner::clock::now());
+                _trace.record({ typeid(job).name(), "deferred", "frame", _runner->_frame, now, now, true });
+            }
+        }
+
+        if (skip) {
+            for (const auto successor : job._successors)
+                successor->_skipped.store(true, std::memory_order_relaxed);
+
+            _runner->complete_job(*this, &job);
+            return;
+        }
+        job._deferrals = 0;
+
+        // Jobs are only run from our main loop, which has just read the clock
+        const auto job_start = _task_start;
+        try {
+            job.execute();
+        }
+        catch (const std::exception& ex) {
+            // TODO: Better error handling
+            std::cout << "job execution exception: " << ex.what() << std::endl;
+        }
+
+        // Measure the job so the arbiter can balance the next cycle
+        const auto job_end = runner::clock::now();
+        _task_end = job_end;
+        job.record_cost(std::chrono::duration_cast<runner::duration>(job_end - job_start).count(), _runner->cost_smoothing);
+
+        if (_runner->tracing.load(std::memory_order_relaxed))
+            _trace.record({ typeid(job).name(), "job", "frame", _runner->_frame, trace_timestamp(job_start), trace_timestamp(job_end), true });
+
+        // Release the children that were waiting on this job
+        _runner->complete_job(*this, &job);
+    }
+
+    task* worker::next_task() {
+        // Pinned jobs go first, they can't be taken off our hands
+        if (const auto pinned = take_pinned())
+            return pinned;
+
+        if (const auto own_job = _jobs.pop())
+            return *own_job;
+
+        // Without stealing, the jobs we release ourselves land on our own
+        // deque, so there is nothing left for us to do except for the pinned
+        // jobs that other workers have yet to release
+        if (!_runner->work_stealing) {
+            while (_pinned_expected.load(std::memory_order_acquire) != 0) {
+                const auto seen_signal = _runner->_work_signal.load(std::memory_order_acquire);
+                if (const auto pinned = take_pinned())
+                    return pinned;
+
+                wait_for_work(seen_signal);
+            }
+
+            return nullptr;
+        }
+
+        // Jobs and tasks are released while the sub-cycle is running, so an
+        // empty pool does not mean we are done until everything has completed
+        while (true) {
+            // Read the signal before looking for work so we can't miss a job
+            // that is released after we searched
+            const auto seen_signal = _runner->_work_signal.load(std::memory_order_acquire);
 
-        // Set the awake flag to false and notify that the thread is done
-        _awake = false;
-        {
-            std::lock_guard guard(lock);
-            _wake_cv.notify_one();
+            if (const auto pinned = take_pinned())
+                return pinned;
+
+            if (const auto stolen = steal())
+                return stolen;
+
+            if (_runner->_outstanding.load(std::memory_order_acquire) == 0)
+                return nullptr;
+
+            wait_for_work(seen_signal);
+        }
+    }
+
+    task* worker::take_pinned() {
+        // Take everything delivered so far at once, reversing it into delivery
+        // order. Only the inbox is ever popped, so there is no ABA problem.
+        if (_inbox == nullptr) {
+            if (_mailbox.load(std::memory_order_relaxed) == nullptr)
+                return nullptr;
+
+            auto delivered = _mailbox.exchange(nullptr, std::memory_order_acquire);
+            while (delivered != nullptr) {
+                const auto next = delivered->_next_delivered;
+                delivered->_next_delivered = _inbox;
+                _inbox = delivered;
+                delivered = next;
+            }
         }
+
+        const auto pinned = _inbox;
+        _inbox = pinned->_next_delivered;
+        _pinned_expected.fetch_sub(1, std::memory_order_relaxed);
+        return pinned;
     }
 
-    worker::worker(sched::runner* runner, const std::uint32_t id, const platform::affinity_mask affinity) {
+    void worker::wait_for_work(const std::uint32_t seen_signal) {
+        if (!_runner->tracing.load(std::memory_order_relaxed)) {
+            _runner->wait_for_work(_idle_spinner, seen_signal);
+            return;
+        }
+
+        const auto wait_start = runner::clock::now();
+        _runner->wait_for_work(_idle_spinner, seen_signal);
+        _trace.record({ "idle", "idle", "frame", _runner->_frame, trace_timestamp(wait_start), trace_timestamp(runner::clock::now()) });
+    }
+
+    task* worker::steal() {
+        // The snapshot is only modified by the arbiter while every worker is
+        // suspended, so it is safe to read without a lock during a sub-cycle
+        const auto& victims = _runner->_workers;
+        const auto victim_count = victims.size();
+        if (victim_count < 2)
+            return nullptr;
+
+        // Rotate the first victim so thieves spread out over the pool instead of
+        // all contending on the same deque
+        const auto start = _steal_cursor++;
+        for (std::size_t i = 0; i < victim_count; i++) {
+            const auto victim = victims[(start + i) % victim_count];
+            if (victim == this)
+                continue;
+
+            // A steal can fail from racing the owner or another thief, so keep
+            // trying as long as the victim still appears to have work
+            while (!victim->_jobs.empty()) {
+                if (const auto stolen = victim->_jobs.steal())
+                    return *stolen;
+            }
+        }
+
+        return nullptr;
+    }
+
+    worker::worker(sched::runner* runner, const std::uint32_t id, const platform::affinity_mask& affinity) {
         // Initialize object
         _runner = runner;
         _id = id;
-        _thread = std::thread{ &worker::worker_main, this };
-        
-        // Set the thread's affinity, allowing the OS to schedule it on specific cores
-        // If affinity is zero, the OS will handle affinity automatically
-        if (affinity != 0)
-            platform::set_thread_affinity(_thread, affinity);
 
-        // Save the affinity for later use (reserved for future use)
+        // Save the affinity, it will be applied once the thread starts
         _affinity = affinity;
     }
 
     worker::~worker() {
-        // Join the thread to ensure that it can properly
-        // destroy itself if not started
-        if (_thread.joinable())
-            _thread.join();
-
-        // Stop the worker
-        stop();
+        // Stop the worker if it is still running
+        if (_active)
+            stop();
     }
 
-    void worker::assign(const std::shared_ptr<job>& job) {
-        // No lock is needed since these are both lock-free
-        job->_worker = this;
+    void worker::assign(job* job) {
+        // No lock is needed since the worker is suspended and the owner end of
+        // the deque is ours until it is woken up
+        job->_worker.store(this, std::memory_order_relaxed);
         _jobs.push(job);
     }
 
-    void worker::detach() {
+    void worker::deliver(job* job) {
+        job->_worker.store(this, std::memory_order_relaxed);
+
+        // Push onto the mailbox, the release publishing the job to us
+        auto head = _mailbox.load(std::memory_order_relaxed);
+        do {
+            job->_next_delivered = head;
+        } while (!_mailbox.compare_exchange_weak(head, job, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    void worker::spawn(task* task) noexcept {
+        _runner->spawn(*this, task);
+    }
+
+    void worker::finish_spawned(std::atomic<std::uint32_t>& pending) noexcept {
+        _runner->finish_task();
+
+        // The counter may be destroyed as soon as it reaches zero, so the
+        // helping worker is woken through the runner instead
+        if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            _runner->signal_work();
+    }
+
+    void worker::help_until(const std::atomic<std::uint32_t>& pending, const std::int64_t depth) {
+        while (pending.load(std::memory_order_acquire) != 0) {
+            // Read the signal before looking for work so we can't miss the
+            // signal sent when the last task finishes
+            const auto seen_signal = _runner->_work_signal.load(std::memory_order_acquire);
+
+            // Only run tasks spawned above the depth. Anything below it belongs
+            // to the job we are helping out of, or to a caller further up.
+            if (_jobs.bottom() > depth) {
+                if (const auto own_task = _jobs.pop()) {
+                    (*own_task)->run(*this);
+                    continue;
+                }
+            }
+
+            // The rest of the tasks were stolen, wait for the thieves to finish
+            if (pending.load(std::memory_order_acquire) != 0)
+                wait_for_work(seen_signal);
+        }
+    }
+
+    void worker::start() {
         if (_active)
-            throw std::runtime_error("worker is already detached");
+            throw std::runtime_error("worker is already started");
 
+        // This must be set before the thread runs, or it may exit right away
         _active = true;
-        _thread.detach();
+        _thread = std::thread{ &worker::worker_main, this };
+
+        // Set the thread's affinity, allowing the OS to schedule it on specific cores
+        // If the mask is empty, the OS will handle affinity automatically
+        if (_affinity.any())
+            platform::set_thread_affinity(_thread, _affinity);
     }
 
     void worker::stop() {
         if (!_active)
             throw std::runtime_error("worker is already stopped");
 
-        // These two variables are atomic, so we don't need to lock
+        // Wake the worker up so it sees that it is no longer active, then wait
+        // for the thread to exit
         _active = false;
-        _awake = true;
+        _wake_signal.fetch_add(1, std::memory_order_release);
+        _wake_signal.notify_one();
 
-        // Notify the worker of var change and wait for another cycle to finish
-        {
-            std::unique_lock lock(mutex);
-            _wake_cv.notify_one();
-            _wake_cv.wait(lock, [this] { return !_awake; });
-        }
+        if (_thread.joinable())
+            _thread.join();
     }
 
     void worker::wake() {
-        // Atomic, no need to lock
-        _awake = true;
-
-        // Notify the worker of var change
-        {
-            std::unique_lock lock(mutex);
-            _wake_cv.notify_one();
-        }
-    }
-
-    void worker::wait_cycle_finish() {
-        std::unique_lock lock(mutex);
-        _wake_cv.wait(lock, [this] { return !_awake; });
+        // The release pairs with the acquire in the worker, making the jobs we
+        // assigned while it was suspended visible
+        _wake_signal.fetch_add(1, std::memory_order_release);
+        _wake_signal.notify_one();
     }
 }
@@ -1,19 +1,20 @@
 #pragma once
 
-#include <condition_variable>
 #include <atomic>
 #include <thread>
-#include <mutex>
 #include <chrono>
 
-#include <tbb/concurrent_queue.h>
-
 #include "platform/current.hpp"
+#include "barrier.hpp"
+#include "frame_arena.hpp"
+#include "trace.hpp"
+#include "work_deque.hpp"
 
 namespace sched {
 	// Forward declarations
 	class runner;
 	class job;
+	class task;
 
 	// Worker class used to execute jobs on separate threads
 	// For internal task scheduling only. For more information, see the runner class.
@@ -34,27 +35,80 @@ namespace sched {
 		// Determines if the thread can cycle
 		std::atomic<bool> _active{ false };
 
-		// Determines if the worker is awake
-		std::atomic<bool> _awake = false;
+		// Incremented every time the worker is woken up. The worker parks on this
+		// value while it is suspended.
+		std::atomic<std::uint32_t> _wake_signal{ 0 };
+
+		// Adaptive spin state used while waiting to be woken up
+		spinner _wake_spinner{};
+
+		// Adaptive spin state used while waiting for other workers to release jobs
+		spinner _idle_spinner{};
+
+		// A collection of tasks that are scheduled to be executed
+		// The owner end is only touched by the arbiter while the worker is suspended,
+		// and by this worker while it is awake. Other workers steal from the top.
+		work_deque<task*> _jobs{};
+
+		// Jobs pinned to this worker, linked through the jobs themselves and in
+		// reverse order of delivery. Other workers can't steal these, but they
+		// push released pinned jobs here during a sub-cycle.
+		std::atomic<job*> _mailbox{};
+
+		// Jobs taken from the mailbox in order of delivery, only touched by us
+		job* _inbox{};
 
-		// Condition variable used for waking
-		std::condition_variable _wake_cv{};
+		// The amount of pinned jobs that have yet to arrive in the mailbox or be
+		// picked up from it in the current sub-cycle. Set by the arbiter while
+		// the worker is suspended.
+		std::atomic<std::uint32_t> _pinned_expected{};
 
-		// A collection of jobs that are scheduled to be executed
-		tbb::concurrent_queue<std::shared_ptr<job>> _jobs{};
+		// Determines which worker is tried first when stealing
+		std::uint32_t _steal_cursor{};
+
+		// Scratch memory for the jobs we run, reset by the arbiter every cycle
+		frame_arena _arena{};
+
+		// The worker's trace events, only read by the arbiter while we are suspended
+		trace_buffer _trace{};
+
+		// The start of the task run by the main loop, and its end if the task
+		// measured it itself. Jobs reuse these instead of reading the clock again.
+		std::chrono::steady_clock::time_point _task_start{};
+		std::chrono::steady_clock::time_point _task_end{};
+
+		// Time spent executing jobs in the current cycle, in seconds
+		// Written by the worker during a cycle and collected by the arbiter after
+		double _busy_time{};
+
+		// The worker running on the current thread, if any
+		static thread_local worker* _current;
 
 		// The entry point to a worker thread
 		void worker_main();
 
-	public:
-		// Mutex for locking non-atomic operations
-		std::mutex mutex{};
+		// Get the next task to execute, stealing from other workers if allowed
+		// Returns nullptr if there is no more work in the sub-cycle
+		task* next_task();
 
+		// Take a job from the mailbox, if there is one
+		task* take_pinned();
+
+		// Attempt to steal a task from another worker in the pool
+		task* steal();
+
+		// Execute a job, measure its cost and report its completion
+		void execute_job(job& job);
+
+		// Wait for other workers to release work, tracing the wait if enabled
+		void wait_for_work(std::uint32_t seen_signal);
+
+	public:
 		// The time delta between two sub-cycles
 		std::atomic<double> cycle_delta{ 0.0 };
 
 		// Instantiate a new worker
-		worker(sched::runner* runner, std::uint32_t id, platform::affinity_mask affinity = 0);
+		worker(sched::runner* runner, std::uint32_t id, const platform::affinity_mask& affinity = {});
 
 		// Destroy the worker
 		~worker();
@@ -63,24 +117,58 @@ namespace sched {
 		auto id() const { return _id; }
 
 		// Get the affinity mask
-		auto affinity() const { return _affinity; }
+		const auto& affinity() const { return _affinity; }
 
 		// Get the runner associated with the worker
 		auto runner() const { return _runner; }
 
-		// Assign a job to the worker and resume the thread
-		void assign(const std::shared_ptr<job>& job);
+		// Get the worker's frame arena. Only safe to be used from the worker's
+		// thread, and memory from it is only valid until the end of the frame.
+		frame_arena& arena() noexcept { return _arena; }
+
+		// Assign a job to the worker. The runner keeps ownership of the job until
+		// the sub-cycle is finished. This is not safe to be called while the worker
+		// is awake.
+		void assign(job* job);
 
-		// Runs the worker independently
-		void detach();
+		// Hand a pinned job to the worker. Unlike assign, this is safe to be
+		// called from other workers while this one is awake.
+		void deliver(job* job);
 
-		// Stop the worker
+		// Start the worker thread
+		void start();
+
+		// Stop the worker and wait for the thread to exit
+		// This is not safe to be called from the worker thread
 		void stop();
 
-		// Force a cycle
+		// Resume the worker for a sub-cycle. The worker arrives at the runner's
+		// cycle barrier once it is done.
 		void wake();
 
-		// Wait until the cycle is finished
-		void wait_cycle_finish();
+		// Get the worker running on the calling thread
+		// Returns nullptr if the thread is not a worker
+		static worker* current() noexcept { return _current; }
+
+		// Push a task onto this worker's deque during a sub-cycle so that idle
+		// workers can steal it. Only safe to be called from the worker's thread.
+		void spawn(task* task) noexcept;
+
+		// Called once a task passed to spawn has finished running. Decrements the
+		// pending counter that a helping worker is waiting on.
+		void finish_spawned(std::atomic<std::uint32_t>& pending) noexcept;
+
+		// Get a position in the worker's deque. Tasks spawned after this call
+		// end up above it. Only safe to be called from the worker's thread.
+		std::int64_t depth() const noexcept { return _jobs.bottom(); }
+
+		// Run the tasks spawned above the given depth that have not been stolen
+		// until the pending counter drops to zero, waiting on thieves otherwise.
+		// Only safe to be called from the worker's thread.
+		void help_until(const std::atomic<std::uint32_t>& pending, std::int64_t depth);
+
+		// Friend classes
+		friend class runner;
+		friend class job;
 	};
 }
@@ -0,0 +1,112 @@
+// Checks that the write job only coalesces setter calls nothing could have seen
+// Runs the write job directly, outside of a runner, so every write is applied
+// in order on the calling thread.
+
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "game/write_job.hpp"
+
+namespace {
+    struct target {
+        int x{};
+        int calls{};
+
+        void set_x(const int value) {
+            x = value;
+            calls++;
+        }
+    };
+
+    int failures = 0;
+
+    void check(const bool condition, const std::string_view what) {
+        if (!condition) {
+            std::cerr << "FAILED: " << what << std::endl;
+            failures++;
+        }
+    }
+
+    // Calls in a row with nothing in between collapse into the last one
+    void test_coalesces_runs() {
+        game::write_job writer{};
+        target a{};
+
+        for (auto value = 1; value <= 5; value++)
+            writer.set(a, &target::set_x, value);
+        writer.execute();
+
+        check(a.x == 5, "a run of setter calls leaves the last value");
+        check(a.calls == 1, "a run of setter calls is applied once");
+        check(writer.stats().coalesced == 4, "the dropped calls are counted");
+    }
+
+    // A closure without a target sees every write queued before it
+    void test_untargeted_closure_sees_writes() {
+        game::write_job writer{};
+        target a{};
+        auto seen = -1;
+
+        writer.set(a, &target::set_x, 10);
+        writer.set(a, &target::set_x, 11);
+        writer.set(a, &target::set_x, 12);
+        writer.enqueue([&] { seen = a.x; });
+        writer.set(a, &target::set_x, 999);
+        writer.execute();
+
+        check(seen == 12, "an untargeted closure sees the write before it");
+        check(a.x == 999, "the write after the closure is applied");
+        check(a.calls == 2, "only the calls before the closure are coalesced");
+        check(writer.stats().coalesced == 2, "calls across a closure are not counted as coalesced");
+    }
+
+    // A closure on the same object sees its writes, one on another object doesn't matter
+    void test_targeted_closure_sees_writes() {
+        game::write_job writer{};
+        target a{};
+        target b{};
+        auto seen = -1;
+
+        writer.set(a, &target::set_x, 1);
+        writer.set(a, &target::set_x, 2);
+        writer.enqueue(a, [&] { seen = a.x; });
+        writer.set(a, &target::set_x, 3);
+        writer.set(b, &target::set_x, 1);
+        writer.enqueue(a, [] {});
+        writer.set(b, &target::set_x, 2);
+        writer.execute();
+
+        check(seen == 2, "a closure on the object sees the write before it");
+        check(a.x == 3 && a.calls == 2, "calls on either side of a closure on the object are both applied");
+        check(b.x == 2 && b.calls == 1, "a closure on another object doesn't stop coalescing");
+    }
+
+    // Writes queued one after another on different threads keep their order
+    void test_keeps_order_across_threads() {
+        game::write_job writer{};
+        std::vector<int> order{};
+
+        writer.enqueue([&] { order.push_back(0); });
+        std::thread{ [&] { writer.enqueue([&] { order.push_back(1); }); } }.join();
+        writer.enqueue([&] { order.push_back(2); });
+        writer.execute();
+
+        check(order == std::vector{ 0, 1, 2 }, "writes from different threads are applied in order");
+    }
+}
+
+int main() {
+    test_coalesces_runs();
+    test_untargeted_closure_sees_writes();
+    test_targeted_closure_sees_writes();
+    test_keeps_order_across_threads();
+
+    if (failures != 0)
+        return EXIT_FAILURE;
+
+    std::cout << "write_job_test passed" << std::endl;
+    return EXIT_SUCCESS;
+}